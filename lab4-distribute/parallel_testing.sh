@@ -0,0 +1,42 @@
+#!/bin/bash
+# runs each input on two cores, sequentially and with -parallel_deterministic=1 at a
+# quantum of 1, and checks that the parallel run takes within TOLERANCE percent of the
+# sequential cycles and repeats exactly. Run it from the lab directory.
+
+CORRECT_TESTS=0
+TOLERANCE=15
+
+declare -a file_list=("br_same.x" "cancel_req.x" "difficult.x" "example.x" "ld_1.x" "ld.x" "mem.x" "st_loop.x" "test_1.x")
+
+mkdir -p test
+
+cd src && make
+cd ..
+
+# the slowest core's cycles
+cycles() {
+	grep -o 'instructions in [0-9]* cycles' $1 | awk 'BEGIN { max = 0 } $3 > max { max = $3 } END { print max }'
+}
+
+for inputfile in "${file_list[@]}";
+do
+	echo "$inputfile"
+	echo "go" | timeout 20 ./src/sim -cores=2 inputs/${inputfile} > test/sequential_${inputfile}.txt
+	echo "go" | timeout 20 ./src/sim -cores=2 -parallel=1 -parallel_deterministic=1 -parallel_quantum=1 inputs/${inputfile} > test/parallel_${inputfile}.txt
+	echo "go" | timeout 20 ./src/sim -cores=2 -parallel=1 -parallel_deterministic=1 -parallel_quantum=1 inputs/${inputfile} > test/parallel_again_${inputfile}.txt
+	sequential=$(cycles test/sequential_${inputfile}.txt)
+	parallel=$(cycles test/parallel_${inputfile}.txt)
+	difference=$(( parallel > sequential ? parallel - sequential : sequential - parallel ))
+	echo "    sequential $sequential cycles, parallel $parallel cycles"
+	if [ "$sequential" -eq 0 ] || [ $(( difference * 100 )) -gt $(( sequential * TOLERANCE )) ]
+	then
+		echo "    FAIL"
+	elif ! diff -q test/parallel_${inputfile}.txt test/parallel_again_${inputfile}.txt > /dev/null
+	then
+		echo "    FAIL (the repeat differs)"
+	else
+		echo "    pass"
+		let "CORRECT_TESTS++"
+	fi
+done
+echo "Correct tests: $CORRECT_TESTS"
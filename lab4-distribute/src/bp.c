@@ -10,56 +10,212 @@
 #include "bp.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 
 
 
-void bp_init(bp_t *bp)
+void bp_init(bp_t *bp, const char *predictor, int history, int table_bits)
 {
-    bp->ghr_bits = 8;
+    memset(bp, 0, sizeof(bp_t));
+    bp->dir = dir_new(predictor, history, table_bits);
+    if (bp->dir == NULL) {
+        printf("Error: unknown branch predictor %s, choose from:", predictor);
+        dir_list();
+        exit(-1);
+    }
+    bp->ghr_bits = bp->dir->history;
     bp->ghr = 0;
-    bp->pht = calloc(PHT_SIZE, sizeof(uint8_t));
+}
 
-    bp->btb_size = BTB_SIZE;
-    bp->btb_bits = 10;
-    bp->btb_valid = calloc(BTB_SIZE, sizeof(bool));
+void bp_init_btb(bp_t *bp, int sets, int ways, int tag_bits, bool ittage)
+{
+    if (sets <= 0 || (sets & (sets - 1)) || ways <= 0 || ways > 64 ||
+            tag_bits < 1 || tag_bits > 32) {
+        printf("Error: BTB needs power-of-two sets, 1-64 ways and 1-32 tag bits\n");
+        exit(-1);
+    }
+    bp->btb_sets = sets;
+    bp->btb_ways = ways;
+    bp->btb_tag_bits = tag_bits;
+    bp->btb = calloc((uint64_t)sets * ways, sizeof(btb_entry_t));
+    bp->btb_valid = calloc(sets, sizeof(uint64_t));
+    bp->btb_repl = repl_new(REPL_LRU, sets, ways);
+    bp->ittage_on = ittage;
 }
 
-void bp_predict(bp_t *bp, uint64_t *PC)
+static inline uint64_t bits_mask(int bits)
 {
-    int btb_index = (*PC >> 2) & 0x3FF; 
-    if (bp->btb_valid[btb_index] && bp->btb_tag[btb_index] == *PC) {
-        if (!bp->btb_cond[btb_index]) {
-            *PC = bp->btb_dest[btb_index];
-        } 
-        else {
-            int pht_index = (bp->ghr ^ ((*PC >> 2) & 0xFF)); 
-            if (bp->pht[pht_index] >= 2) {
-                *PC = bp->btb_dest[btb_index];
-            }
-            else *PC += 4;
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+static inline int btb_set(bp_t *bp, uint64_t PC)
+{
+    return (PC >> 2) & (bp->btb_sets - 1);
+}
+
+static inline uint32_t btb_tag(bp_t *bp, uint64_t PC)
+{
+    return (PC >> 2) / bp->btb_sets & bits_mask(bp->btb_tag_bits);
+}
+
+static btb_entry_t *btb_find(bp_t *bp, uint64_t PC, int *way_out)
+{
+    int set = btb_set(bp, PC);
+    uint32_t tag = btb_tag(bp, PC);
+    btb_entry_t *row = &bp->btb[(uint64_t)set * bp->btb_ways];
+    for (int way = 0; way < bp->btb_ways; way++) {
+        if ((bp->btb_valid[set] >> way & 1) && row[way].tag == tag) {
+            *way_out = way;
+            return &row[way];
         }
-    } 
-    else *PC += 4;
+    }
+    return NULL;
 }
 
-void bp_update(bp_t *bp, uint64_t PC, uint64_t target, bool taken, bool is_cond) 
+/***************************************************************/
+/* ITTAGE: tagged target tables over geometrically longer      */
+/* slices of the path history; the BTB target is the base      */
+/***************************************************************/
+
+static const int ITTAGE_HISTORY[ITTAGE_TABLES] = { 8, 16, 32 };
+
+static inline uint64_t path_fold(uint64_t path, int len, int bits)
+{
+    uint64_t h = path & bits_mask(len), folded = 0;
+    for (; h; h >>= bits)
+        folded ^= h & bits_mask(bits);
+    return folded;
+}
+
+static inline ittage_entry_t *ittage_entry(bp_t *bp, uint64_t PC, int t)
+{
+    uint64_t index = (PC >> 2) ^ path_fold(bp->path, ITTAGE_HISTORY[t], ITTAGE_TABLE_BITS);
+    return &bp->ittage[t][index & bits_mask(ITTAGE_TABLE_BITS)];
+}
+
+static inline uint16_t ittage_tag(bp_t *bp, uint64_t PC, int t)
+{
+    uint64_t h = path_fold(bp->path, ITTAGE_HISTORY[t], ITTAGE_TAG_BITS);
+    return (((PC >> 2) >> ITTAGE_TABLE_BITS) ^ h ^ (t + 1)) & bits_mask(ITTAGE_TAG_BITS);
+}
+
+/* longest table with a tag match, -1 for none */
+static int ittage_provider(bp_t *bp, uint64_t PC)
+{
+    for (int t = ITTAGE_TABLES - 1; t >= 0; t--) {
+        ittage_entry_t *e = ittage_entry(bp, PC, t);
+        if (e->target && e->tag == ittage_tag(bp, PC, t))
+            return t;
+    }
+    return -1;
+}
+
+static uint64_t ittage_predict(bp_t *bp, uint64_t PC, uint64_t fallback)
+{
+    int t = ittage_provider(bp, PC);
+    return t < 0 ? fallback : ittage_entry(bp, PC, t)->target;
+}
+
+static void ittage_update(bp_t *bp, uint64_t PC, uint64_t target, uint64_t fallback)
+{
+    int provider = ittage_provider(bp, PC);
+    uint64_t predicted = fallback;
+
+    if (provider >= 0) {
+        ittage_entry_t *e = ittage_entry(bp, PC, provider);
+        predicted = e->target;
+        if (e->target == target) {
+            if (e->ctr < 3)
+                e->ctr++;
+            e->useful = 1;
+        }
+        else if (e->ctr > 0)
+            e->ctr--;
+        else
+            e->target = target;
+    }
+    if (predicted == target)
+        return;
+
+    /* claim an entry in a longer table; age them all if none is free */
+    for (int t = provider + 1; t < ITTAGE_TABLES; t++) {
+        ittage_entry_t *e = ittage_entry(bp, PC, t);
+        if (!e->useful) {
+            e->tag = ittage_tag(bp, PC, t);
+            e->target = target;
+            e->ctr = 0;
+            return;
+        }
+    }
+    for (int t = provider + 1; t < ITTAGE_TABLES; t++)
+        ittage_entry(bp, PC, t)->useful = 0;
+}
+
+void bp_predict(bp_t *bp, uint64_t *PC)
+{
+    int way;
+    bp->btb_lookups++;
+    btb_entry_t *e = btb_find(bp, *PC, &way);
+    if (e == NULL) {
+        bp->btb_misses++;
+        *PC += 4;
+        return;
+    }
+
+    switch (e->kind) {
+        case BP_COND:
+            if (bp->dir->predict(bp->dir, *PC, bp->ghr))
+                *PC = e->dest;
+            else
+                *PC += 4;
+            break;
+        case BP_INDIRECT:
+            *PC = bp->ittage_on ? ittage_predict(bp, *PC, e->dest) : e->dest;
+            break;
+        default:
+            *PC = e->dest;
+    }
+}
+
+void bp_update(bp_t *bp, uint64_t PC, uint64_t target, bool taken, bp_kind_t kind) 
 {    
-    if (is_cond) {
-        int pht_index = (bp->ghr ^ ((PC >> 2) & 0xFF));
+    if (kind == BP_NONE)
+        return;
 
-        if (taken && bp->pht[pht_index] < 3) bp->pht[pht_index]++;
-        else if (!taken && bp->pht[pht_index] > 0) bp->pht[pht_index]--;
+    if (kind == BP_COND) {
+        bp->dir->update(bp->dir, PC, bp->ghr, taken);
 
-        bp->ghr = ((bp->ghr << 1) | (taken ? 1 : 0)) & 0xFF;
+        bp->ghr = (bp->ghr << 1) | (taken ? 1 : 0);
+        if (bp->ghr_bits < 64)
+            bp->ghr &= (1ULL << bp->ghr_bits) - 1;
     }
 
-    int btb_index = (PC >> 2) & 0x3FF;
-    if (!bp->btb_valid[btb_index] || bp->btb_tag[btb_index] != PC)
-    {
-        bp->btb_tag[btb_index] = PC;
-        bp->btb_dest[btb_index] = target;
-        bp->btb_valid[btb_index] = true;
-        bp->btb_cond[btb_index] = is_cond;
+    int way;
+    int set = btb_set(bp, PC);
+    btb_entry_t *e = btb_find(bp, PC, &way);
+
+    if (kind == BP_INDIRECT && bp->ittage_on)
+        ittage_update(bp, PC, target, e ? e->dest : PC + 4);
+
+    /* only taken outcomes carry a target worth remembering */
+    if (taken) {
+        if (e == NULL) {
+            uint64_t all = bits_mask(bp->btb_ways);
+            uint64_t invalid = ~bp->btb_valid[set] & all;
+            way = invalid ? __builtin_ctzll(invalid) : repl_victim(bp->btb_repl, set);
+            e = &bp->btb[(uint64_t)set * bp->btb_ways + way];
+            e->tag = btb_tag(bp, PC);
+            bp->btb_valid[set] |= 1ULL << way;
+            repl_fill(bp->btb_repl, set, way);
+        }
+        else
+            repl_hit(bp->btb_repl, set, way);
+        e->kind = kind;
+        e->dest = target;
+
+        bp->path = (bp->path << PATH_BITS_PER_BRANCH) ^
+                   ((target >> 2) & bits_mask(PATH_BITS_PER_BRANCH));
     }
 }
 
@@ -68,7 +224,50 @@ bool predicted(uint64_t prediction, uint64_t target)
     return prediction == target;
 }
 
+void bp_clear_stats(bp_t *bp)
+{
+    bp->branches = bp->cond_branches = bp->indirect_branches = 0;
+    bp->mispredicts = bp->cond_mispredicts = bp->indirect_mispredicts = 0;
+    bp->btb_lookups = bp->btb_misses = 0;
+    bp->flush_cycles = 0;
+}
+
+void bp_print_stats(bp_t *bp)
+{
+    printf("Branch prediction (%s, %d-bit history):\n", bp->dir->name, bp->ghr_bits);
+    printf("  branches %" PRIu64 "  mispredicted %" PRIu64 " (%.2f%%)\n",
+           bp->branches, bp->mispredicts,
+           bp->branches ? 100.0 * bp->mispredicts / bp->branches : 0.0);
+    printf("  conditional %" PRIu64 "  mispredicted %" PRIu64 " (%.2f%%)\n",
+           bp->cond_branches, bp->cond_mispredicts,
+           bp->cond_branches ? 100.0 * bp->cond_mispredicts / bp->cond_branches : 0.0);
+    printf("  indirect %" PRIu64 "  mispredicted %" PRIu64 "\n",
+           bp->indirect_branches, bp->indirect_mispredicts);
+    printf("  BTB %dx%d, %d-bit tags: lookups %" PRIu64 "  misses %" PRIu64 "\n",
+           bp->btb_sets, bp->btb_ways, bp->btb_tag_bits, bp->btb_lookups, bp->btb_misses);
+    printf("  flush cycles %" PRIu64 "\n", bp->flush_cycles);
+}
+
+void bp_checkpoint(bp_t *bp, ckpt_t *ck)
+{
+    bp_t keep = *bp;
+    ckpt_section(ck, "bp");
+    ckpt_var(ck, *bp);
+    if (ckpt_loading(ck)) {
+        bp->dir = keep.dir;
+        bp->btb = keep.btb;
+        bp->btb_valid = keep.btb_valid;
+        bp->btb_repl = keep.btb_repl;
+    }
+    bp->dir->checkpoint(bp->dir, ck);
+    ckpt_blob(ck, bp->btb, (uint64_t)bp->btb_sets * bp->btb_ways * sizeof(btb_entry_t));
+    ckpt_blob(ck, bp->btb_valid, bp->btb_sets * sizeof(uint64_t));
+    repl_checkpoint(bp->btb_repl, bp->btb_sets, ck);
+}
+
 void bp_free(bp_t *bp) {
-    free(bp->pht);
+    bp->dir->destroy(bp->dir);
+    free(bp->btb);
     free(bp->btb_valid);
+    repl_destroy(bp->btb_repl);
 }
\ No newline at end of file
@@ -12,30 +12,76 @@
 
 #include <stdint.h>
 #include "stdbool.h"
-#define PHT_SIZE 256
-#define BTB_SIZE 1024
+#include "dirpred.h"
+#include "repl.h"
+
+#define ITTAGE_TABLES       3
+#define ITTAGE_TABLE_BITS   8
+#define ITTAGE_TAG_BITS     10
+#define PATH_BITS_PER_BRANCH 4  /* target bits each taken branch adds to the path */
+
+/* what bp_update is told about a resolved instruction */
+typedef enum {
+    BP_NONE,                /* not a branch */
+    BP_COND,                /* CBZ, CBNZ, B.cond */
+    BP_JUMP,                /* B */
+    BP_INDIRECT,            /* BR */
+} bp_kind_t;
+
+/* BTB entries hold a partial tag; aliasing PCs share an entry */
+typedef struct {
+    uint32_t tag;
+    uint8_t kind;
+    uint64_t dest;
+} btb_entry_t;
+
+/* ITTAGE entry: a target and a confidence that gates replacing it */
+typedef struct {
+    uint16_t tag;
+    uint8_t ctr;            /* 2-bit */
+    uint8_t useful;         /* 1-bit */
+    uint64_t target;
+} ittage_entry_t;
 
 typedef struct
 {
-     /* gshare */
+     /* direction predictor and the global history it reads */
+     dir_predictor_t *dir;
      int ghr_bits;
-     uint32_t ghr;
-     uint8_t *pht; 
- 
-     /* BTB */
-     int btb_size;
-     int btb_bits;
-     uint64_t btb_tag[BTB_SIZE];
-     uint64_t btb_dest[BTB_SIZE];
-     bool *btb_valid;
-     bool btb_cond[BTB_SIZE];
+     uint64_t ghr;
+
+     /* set-associative BTB */
+     int btb_sets, btb_ways, btb_tag_bits;
+     btb_entry_t *btb;
+     uint64_t *btb_valid;       /* one way mask per set */
+     repl_t *btb_repl;
+
+     /* indirect targets, indexed by the path of recent taken branches */
+     bool ittage_on;
+     uint64_t path;
+     ittage_entry_t ittage[ITTAGE_TABLES][1 << ITTAGE_TABLE_BITS];
+
+     /* statistics */
+     uint64_t branches;         /* resolved control transfers */
+     uint64_t cond_branches;
+     uint64_t mispredicts;
+     uint64_t cond_mispredicts;
+     uint64_t indirect_branches;
+     uint64_t indirect_mispredicts;
+     uint64_t btb_lookups;
+     uint64_t btb_misses;
+     uint64_t flush_cycles;     /* fetch slots lost to redirects */
 } bp_t;
 
 
-void bp_init(bp_t *bp);
+void bp_init(bp_t *bp, const char *predictor, int history, int table_bits);
+void bp_init_btb(bp_t *bp, int sets, int ways, int tag_bits, bool ittage);
 void bp_predict(bp_t *bp, uint64_t *PC);
-void bp_update(bp_t *bp, uint64_t PC, uint64_t target, bool taken, bool is_cond);
+void bp_update(bp_t *bp, uint64_t PC, uint64_t target, bool taken, bp_kind_t kind);
 bool predicted(uint64_t prediction, uint64_t target);
+void bp_clear_stats(bp_t *bp);
+void bp_print_stats(bp_t *bp);
 void bp_free(bp_t *bp);
+void bp_checkpoint(bp_t *bp, ckpt_t *ck);
 
 #endif
@@ -6,105 +6,810 @@
  */
 
 #include "cache.h"
+#include "coherence.h"
+#include "core.h"
+#include "parallel.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
+/* tags per set are padded so vector loads never run into the next set */
+#define TAG_VECTOR 4
 
-cache_t *cache_new(int sets, int ways)
+
+static int log2_exact(int value, const char *what)
+{
+    int bits = 0;
+    while ((1 << bits) < value)
+        bits++;
+    if (value <= 0 || (1 << bits) != value) {
+        printf("Error: cache %s (%d) must be a power of two\n", what, value);
+        exit(-1);
+    }
+    return bits;
+}
+
+cache_t *cache_new(int block_size, int sets, int ways, int hit_latency, int miss_latency,
+                   repl_policy_t policy)
 {
-    cache_t *cache = (cache_t *)malloc(sizeof(cache_t));
+    cache_t *cache = (cache_t *)calloc(1, sizeof(cache_t));
     cache->num_sets = sets;
     cache->num_ways = ways;
-    cache->accesses = 0;
-    cache->cycles = 0;
-    cache->waiting = false;
-
-    cache->sets = (cache_block_t **)malloc(sizeof(cache_block_t *) * sets);
+    cache->block_size = block_size;
+    cache->hit_latency = hit_latency;
+    cache->miss_latency = miss_latency;
 
-    for (int i = 0; i < sets; i++) {
-        cache->sets[i] = (cache_block_t *)calloc(ways, sizeof(cache_block_t));
+    cache->block_bits = log2_exact(block_size, "block size");
+    cache->tag_shift = cache->block_bits + log2_exact(sets, "set count");
+    cache->set_mask = sets - 1;
+    if (ways <= 0 || ways > 64) {
+        printf("Error: cache associativity (%d) must be between 1 and 64\n", ways);
+        exit(-1);
     }
 
+    cache->way_stride = (ways + TAG_VECTOR - 1) / TAG_VECTOR * TAG_VECTOR;
+    cache->tags = (uint64_t *)calloc((uint64_t)sets * cache->way_stride, sizeof(uint64_t));
+    cache->valid = (uint64_t *)calloc(sets, sizeof(uint64_t));
+    cache->dirty = (uint64_t *)calloc(sets, sizeof(uint64_t));
+    cache->write_back = true;
+    cache->write_allocate = true;
+    cache->repl = repl_new(policy, sets, ways);
+
     return cache;
 }
 
-void cache_destroy(cache_t *c)
+void cache_checkpoint(cache_t *c, ckpt_t *ck)
 {
-    for (int i = 0; i < c->num_sets; i++){
-        free(c->sets[i]);
+    cache_t keep = *c;
+    ckpt_section(ck, "cache");
+    ckpt_var(ck, *c);
+    if (ckpt_loading(ck)) {
+        c->next = keep.next;
+        c->tags = keep.tags;
+        c->valid = keep.valid;
+        c->repl = keep.repl;
+        c->dirty = keep.dirty;
+        c->wbuf = keep.wbuf;
+        c->channel = keep.channel;
+        c->mshrs = keep.mshrs;
+        c->prefetcher = keep.prefetcher;
+        c->prefetched = keep.prefetched;
+        c->bus = keep.bus;
+        c->invalidated = keep.invalidated;
+        c->changed = keep.changed;
+        if (c->changed)
+            memset(c->changed, 0xFF, (c->num_sets + 63) / 64 * sizeof(uint64_t));
+    }
+    ckpt_blob(ck, c->tags, (uint64_t)c->num_sets * c->way_stride * sizeof(uint64_t));
+    ckpt_blob(ck, c->valid, c->num_sets * sizeof(uint64_t));
+    ckpt_blob(ck, c->dirty, c->num_sets * sizeof(uint64_t));
+    ckpt_blob(ck, c->wbuf, c->wbuf_size * sizeof(uint64_t));
+    ckpt_blob(ck, c->mshrs, c->num_mshrs * sizeof(mshr_t));
+    repl_checkpoint(c->repl, c->num_sets, ck);
+    if (c->prefetcher) {
+        ckpt_var(ck, *c->prefetcher);
+        ckpt_blob(ck, c->prefetched, c->num_sets * sizeof(uint64_t));
     }
-    free(c->sets);
+}
+
+void cache_destroy(cache_t *c)
+{
+    free(c->tags);
+    free(c->valid);
+    free(c->dirty);
+    free(c->wbuf);
+    if (c->repl)
+        repl_destroy(c->repl);
+    free(c->mshrs);
+    if (c->prefetcher)
+        prefetch_destroy(c->prefetcher);
+    free(c->prefetched);
+    free(c->invalidated);
+    free(c->changed);
     free(c);
 }
 
-int cache_update(cache_t *c, uint64_t addr)
+/* Way of set_idx holding tag, or -1. All ways are compared at once and
+ * the match mask is filtered through the set's valid bits. */
+static inline int cache_find(cache_t *c, int set_idx, uint64_t tag)
 {
-    int set_idx;
-    uint64_t tag;
-    
-    if (c->num_sets == 64){
-        set_idx = (addr >> 5) & 0x3F;
-        tag = addr >> 11;
+    const uint64_t *tags = &c->tags[(uint64_t)set_idx * c->way_stride];
+    uint64_t valid = c->valid[set_idx];
+    uint64_t match = 0;
+
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x(tag);
+    for (int i = 0; i < c->num_ways; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&tags[i]), key);
+        match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
     }
-    else{
-        set_idx = (addr >> 5) & 0xFF;
-        tag = addr >> 13;
+#elif defined(__SSE2__)
+    /* no 64-bit compare before SSE4.1: AND each 32-bit half with its twin */
+    __m128i key = _mm_set1_epi64x(tag);
+    for (int i = 0; i < c->num_ways; i += 2) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&tags[i]), key);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        match |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
     }
+#else
+    for (int i = 0; i < c->num_ways; i++)
+        match |= (uint64_t)(tags[i] == tag) << i;
+#endif
+
+    match &= valid;
+    return match ? __builtin_ctzll(match) : -1;
+}
+
+static int cache_place(cache_t *c, uint64_t addr);
+static void cache_prefetch(cache_t *c, uint64_t addr, uint64_t pc, bool trigger);
+
+/* first demand touch of a prefetched block */
+static bool cache_prefetch_used(cache_t *c, int set_idx, int way)
+{
+    if (!c->prefetched || !(c->prefetched[set_idx] & (1ULL << way)))
+        return false;
+    c->prefetched[set_idx] &= ~(1ULL << way);
+    c->prefetcher->useful++;
+    return true;
+}
+
+/* A demand miss on a block the prefetcher already has in flight takes
+ * the prefetch over. Returns the cycles left on it, or -1. */
+static int cache_prefetch_claim(cache_t *c, uint64_t addr)
+{
+    uint64_t block = addr >> c->block_bits;
+    if (!c->prefetcher)
+        return -1;
+    for (int i = 0; i < PREFETCH_QUEUE; i++) {
+        mshr_t *m = &c->pf_queue[i];
+        if (m->valid && m->block == block) {
+            m->valid = false;
+            c->prefetcher->late++;
+            return m->ready > c->now ? m->ready - c->now : 0;
+        }
+    }
+    return -1;
+}
+
+/* a miss to a block a peer's write took from us */
+static void cache_coherence_miss(cache_t *c, int set_idx, uint64_t tag)
+{
+    const uint64_t *tags = &c->tags[(uint64_t)set_idx * c->way_stride];
+    for (uint64_t ways = c->invalidated[set_idx]; ways; ways &= ways - 1) {
+        int way = __builtin_ctzll(ways);
+        if (tags[way] == tag) {
+            c->coherence_misses++;
+            c->invalidated[set_idx] &= ~(1ULL << way);
+            return;
+        }
+    }
+}
+
+/* Probe for addr and return how many cycles the access has to wait,
+ * 0 if it can proceed this cycle. A miss leaves fill_pending set so
+ * cache_complete installs the block once the wait is over. */
+static int cache_access(cache_t *c, uint64_t addr, uint64_t pc, bool write)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    uint64_t tag = addr >> c->tag_shift;
 
     c->accesses++;
-    cache_block_t *set = c->sets[set_idx];
+    c->fill_dirty = false;
+    c->replay = false;
+
+    int way = cache_find(c, set_idx, tag);
+    if (way >= 0) {
+        int upgrade = write && c->bus ? coherence_write(c, addr, true) : 0;
+        repl_hit(c->repl, set_idx, way);
+        cache_prefetch(c, addr, pc, cache_prefetch_used(c, set_idx, way));
+        /* the last block delivered stays in the line buffer */
+        if (c->ready && c->ready_block == addr >> c->block_bits)
+            return upgrade;
+        c->fill_pending = false;
+        if (c->hit_latency + upgrade == 0)
+            return 0;
+        c->ready = false;
+        return c->hit_latency + upgrade;
+    }
+
+    c->misses++;
+    c->ready = false;
+    int peer = -1;
+    if (c->bus) {
+        cache_coherence_miss(c, set_idx, tag);
+        peer = write ? coherence_write(c, addr, false) : coherence_read(c, addr);
+    }
+    int latency = cache_prefetch_claim(c, addr);
+    if (latency < 0)
+        latency = peer >= 0 ? peer : cache_miss_penalty(c, addr);
+    c->fill_pending = latency > 0;
+    c->fill_block = addr >> c->block_bits;
+    if (!c->fill_pending)
+        cache_insert(c, addr);
+    cache_prefetch(c, addr, pc, true);
+    return latency; 
+}
 
-    for (int i = 0; i < c->num_ways; i++) {
-        if (set[i].valid && set[i].tag == tag) {
-            set[i].last_used = c->accesses;
-            return 0; 
+int cache_update(cache_t *c, uint64_t addr, uint64_t pc)
+{
+    return cache_access(c, addr, pc, false);
+}
+
+/* Queue one block write on the channel and return when it is done. */
+static uint64_t channel_write(mem_channel_t *ch, uint64_t now)
+{
+    if (!ch)
+        return now;
+    ch->writes++;
+    ch->busy_until = (ch->busy_until > now ? ch->busy_until : now) + ch->write_cycles;
+    return ch->busy_until;
+}
+
+/* Write addr's block below c starting at cycle start: the next level
+ * takes it as a dirty block, or it goes out over the memory channel.
+ * Returns the cycle the write is done. */
+static uint64_t cache_write_below(cache_t *c, uint64_t addr, uint64_t start)
+{
+    if (core_threaded) {
+        /* the shared levels take it at the next barrier */
+        parallel_defer(c, addr, start, true);
+        if (c->next)
+            return start + c->next->hit_latency;
+        mem_channel_t *ch = c->channel;
+        if (!ch)
+            return start;
+        return (ch->busy_until > start ? ch->busy_until : start) + ch->write_cycles;
+    }
+    if (c->next == NULL)
+        return channel_write(c->channel, start);
+
+    cache_t *next = c->next;
+    next->now = start;
+    int way = cache_place(next, addr);
+    next->dirty[(addr >> next->block_bits) & next->set_mask] |= 1ULL << way;
+    return start + next->hit_latency;
+}
+
+/* Hand a store to the write buffer and return how long it waits for a
+ * free entry. */
+static int cache_buffer_write(cache_t *c, uint64_t addr)
+{
+    if (c->wbuf_size == 0) {
+        cache_write_below(c, addr, c->now);
+        return 0;
+    }
+
+    int oldest = 0;
+    for (int i = 1; i < c->wbuf_size; i++) {
+        if (c->wbuf[i] < c->wbuf[oldest])
+            oldest = i;
+    }
+    uint64_t start = c->wbuf[oldest] > c->now ? c->wbuf[oldest] : c->now;
+    int wait = start - c->now;
+    c->wbuf_stalls += wait;
+    c->wbuf[oldest] = cache_write_below(c, addr, start);
+    return wait;
+}
+
+static inline void cache_changed(cache_t *c, int set_idx)
+{
+    if (c->changed)
+        c->changed[set_idx >> 6] |= 1ULL << (set_idx & 63);
+}
+
+static void cache_mark_dirty(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    cache_changed(c, set_idx);
+    int way = cache_find(c, set_idx, addr >> c->tag_shift);
+    if (way >= 0)
+        c->dirty[set_idx] |= 1ULL << way;
+    else
+        c->fill_dirty = true;
+}
+
+/* A store. Hits and allocating misses go through cache_update; a
+ * write-back cache marks the block dirty, a write-through one also
+ * sends the store to the write buffer. A non-allocating miss only
+ * goes to the write buffer. */
+int cache_write(cache_t *c, uint64_t addr, uint64_t pc)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    bool hit = cache_find(c, set_idx, addr >> c->tag_shift) >= 0;
+
+    /* a store that waited was already written when it first came in */
+    if (c->replay && c->ready_block == addr >> c->block_bits) {
+        c->replay = false;
+        return 0;
+    }
+    c->replay = false;
+
+    if (!hit && !c->write_allocate) {
+        c->accesses++;
+        c->misses++;
+        if (c->bus)
+            coherence_write(c, addr, false);
+        return cache_buffer_write(c, addr);
+    }
+
+    int wait = cache_access(c, addr, pc, true);
+    if (c->write_back) {
+        cache_mark_dirty(c, addr);
+        return wait;
+    }
+    int buffered = cache_buffer_write(c, addr);
+    return buffered > wait ? buffered : wait;
+}
+
+/* Cycles for a miss in c at cycle now to be served: walk the lower
+ * levels until one hits, filling each level that misses on the way
+ * unless this is only a probe. */
+static int cache_walk(cache_t *c, uint64_t addr, uint64_t now, bool probe)
+{
+    int latency = 0;
+    for (cache_t *level = c->next; level; level = level->next) {
+        int set_idx = (addr >> level->block_bits) & level->set_mask;
+        int way = cache_find(level, set_idx, addr >> level->tag_shift);
+
+        latency += level->hit_latency;
+        if (!probe) {
+            level->now = now;
+            level->accesses++;
+        }
+        if (way >= 0) {
+            if (!probe)
+                repl_hit(level->repl, set_idx, way);
+            return latency;
         }
+        if (!probe) {
+            level->misses++;
+            cache_insert(level, addr);
+        }
+        c = level;
     }
 
-    return 1; 
+    /* wait for writebacks already holding the memory channel */
+    mem_channel_t *ch = c->channel;
+    if (ch && ch->busy_until > now + latency) {
+        if (!probe)
+            ch->stall_cycles += ch->busy_until - (now + latency);
+        latency = ch->busy_until - now;
+    }
+    return latency + c->miss_latency;
 }
 
-void cache_insert(cache_t *c, uint64_t addr){
-    int set_idx;
-    uint64_t tag;
-    
-    if (c->num_sets == 64){
-        set_idx = (addr >> 5) & 0x3F;
-        tag = addr >> 11;
-    }
-    else{
-        set_idx = (addr >> 5) & 0xFF;
-        tag = addr >> 13;
-    }
-
-    cache_block_t *set = c->sets[set_idx];
-
-    int lru_idx = 0;
-    uint64_t last_used = set[0].last_used;
-    
-    for (int i = 1; i < c->num_ways; i++) {
-        if (!set[i].valid) {
-            set[i].valid = true;
-            set[i].tag = tag;
-            set[i].last_used = c->accesses;
+/* On a core thread the shared levels are only probed, as they stood at
+ * the last barrier, and see the miss when the barrier replays it. */
+int cache_miss_penalty(cache_t *c, uint64_t addr)
+{
+    if (core_threaded)
+        parallel_defer(c, addr, c->now, false);
+    return cache_walk(c, addr, c->now, core_threaded);
+}
+
+void cache_below(cache_t *c, uint64_t addr, uint64_t now, bool write)
+{
+    if (write)
+        cache_write_below(c, addr, now);
+    else
+        cache_walk(c, addr, now, false);
+}
+
+void cache_set_write_policy(cache_t *c, bool write_back, bool write_allocate,
+                            int wbuf_size)
+{
+    if (wbuf_size < 0) {
+        printf("Error: write_buffer (%d) must be at least 0\n", wbuf_size);
+        exit(-1);
+    }
+    c->write_back = write_back;
+    c->write_allocate = write_allocate;
+    c->wbuf_size = wbuf_size;
+    free(c->wbuf);
+    c->wbuf = wbuf_size ? (uint64_t *)calloc(wbuf_size, sizeof(uint64_t)) : NULL;
+}
+
+void cache_alloc_mshrs(cache_t *c, int count)
+{
+    if (count < 0) {
+        printf("Error: dcache_mshrs (%d) must be at least 0\n", count);
+        exit(-1);
+    }
+    free(c->mshrs);
+    c->num_mshrs = count;
+    c->mshrs = count ? (mshr_t *)calloc(count, sizeof(mshr_t)) : NULL;
+}
+
+/* Non-blocking access. A miss is recorded in an MSHR, or merged into
+ * the one already fetching its block, and the return value is the
+ * number of cycles until its data arrives. Returns -1 without touching
+ * anything for a hit or when every MSHR is busy, and the caller falls
+ * back to cache_update. */
+int cache_issue(cache_t *c, uint64_t addr, uint64_t pc, uint64_t now, bool write)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    uint64_t block = addr >> c->block_bits;
+    mshr_t *free_mshr = NULL;
+
+    if (c->num_mshrs == 0 || cache_find(c, set_idx, addr >> c->tag_shift) >= 0)
+        return -1;
+    /* only write-back write-allocate stores wait on a fill */
+    if (write && !(c->write_back && c->write_allocate))
+        return -1;
+
+    for (int i = 0; i < c->num_mshrs; i++) {
+        mshr_t *m = &c->mshrs[i];
+        if (!m->valid) {
+            if (!free_mshr)
+                free_mshr = m;
+        }
+        else if (m->block == block) {
+            c->accesses++;
+            c->misses++;
+            c->mshr_merges++;
+            if (write && !m->dirty && c->bus)
+                coherence_write(c, addr, false);
+            m->dirty |= write;
+            cache_prefetch(c, addr, pc, true);
+            return m->ready > now ? m->ready - now : 0;
+        }
+    }
+    if (!free_mshr) {
+        c->mshr_full++;
+        return -1;
+    }
+
+    c->accesses++;
+    c->misses++;
+    int peer = -1;
+    if (c->bus) {
+        cache_coherence_miss(c, set_idx, addr >> c->tag_shift);
+        peer = write ? coherence_write(c, addr, false) : coherence_read(c, addr);
+    }
+    int latency = cache_prefetch_claim(c, addr);
+    if (latency < 0)
+        latency = peer >= 0 ? peer : cache_miss_penalty(c, addr);
+    if (latency == 0) {
+        int way = cache_place(c, addr);
+        if (write)
+            c->dirty[set_idx] |= 1ULL << way;
+    }
+    else {
+        free_mshr->valid = true;
+        free_mshr->dirty = write;
+        free_mshr->block = block;
+        free_mshr->ready = now + latency;
+    }
+    cache_prefetch(c, addr, pc, true);
+    return latency;
+}
+
+void cache_set_prefetcher(cache_t *c, prefetch_kind_t kind, int degree)
+{
+    if (c->prefetcher) {
+        prefetch_destroy(c->prefetcher);
+        free(c->prefetched);
+        c->prefetcher = NULL;
+        c->prefetched = NULL;
+    }
+    if (kind == PREFETCH_NONE)
+        return;
+    c->prefetcher = prefetch_new(kind, degree, c->block_bits);
+    c->prefetched = (uint64_t *)calloc(c->num_sets, sizeof(uint64_t));
+    for (int i = 0; i < PREFETCH_QUEUE; i++)
+        c->pf_queue[i].valid = false;
+}
+
+static bool cache_in_flight(cache_t *c, uint64_t block)
+{
+    if (c->fill_pending && c->fill_block == block)
+        return true;
+    for (int i = 0; i < c->num_mshrs; i++) {
+        if (c->mshrs[i].valid && c->mshrs[i].block == block)
+            return true;
+    }
+    for (int i = 0; i < PREFETCH_QUEUE; i++) {
+        if (c->pf_queue[i].valid && c->pf_queue[i].block == block)
+            return true;
+    }
+    return false;
+}
+
+static void cache_place_prefetch(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    c->prefetched[set_idx] |= 1ULL << cache_place(c, addr);
+}
+
+/* Train the prefetcher on a demand access and send its candidates
+ * that are neither cached nor already on their way. */
+static void cache_prefetch(cache_t *c, uint64_t addr, uint64_t pc, bool trigger)
+{
+    uint64_t targets[PREFETCH_MAX_DEGREE];
+    if (!c->prefetcher)
+        return;
+
+    int count = prefetch_train(c->prefetcher, addr, pc, trigger, targets);
+    for (int i = 0; i < count; i++) {
+        if (!cache_prefetch_block(c, targets[i]))
             return;
+    }
+}
+
+/* Send a prefetch for addr's block unless it is cached or already on
+ * its way. Returns false when the prefetch queue is full. */
+bool cache_prefetch_block(cache_t *c, uint64_t addr)
+{
+    uint64_t block = addr >> c->block_bits;
+    int set_idx = block & c->set_mask;
+    if (!c->prefetcher)
+        return false;
+    if (cache_find(c, set_idx, addr >> c->tag_shift) >= 0 || cache_in_flight(c, block))
+        return true;
+
+    mshr_t *slot = NULL;
+    for (int j = 0; j < PREFETCH_QUEUE && !slot; j++) {
+        if (!c->pf_queue[j].valid)
+            slot = &c->pf_queue[j];
+    }
+    if (!slot)
+        return false;
+
+    c->prefetcher->issued++;
+    int latency = cache_miss_penalty(c, addr);
+    if (latency == 0) {
+        cache_place_prefetch(c, addr);
+        return true;
+    }
+    slot->valid = true;
+    slot->block = block;
+    slot->ready = c->now + latency;
+    return true;
+}
+
+/* Install every fill that has arrived by cycle now. */
+void cache_tick(cache_t *c, uint64_t now)
+{
+    int busy = 0;
+    c->now = now;
+    for (int i = 0; i < c->num_mshrs; i++) {
+        mshr_t *m = &c->mshrs[i];
+        if (!m->valid)
+            continue;
+        if (m->ready <= now) {
+            int way = cache_place(c, m->block << c->block_bits);
+            if (m->dirty)
+                c->dirty[m->block & c->set_mask] |= 1ULL << way;
+            m->valid = false;
+        }
+        else
+            busy++;
+    }
+    for (int i = 0; c->prefetcher && i < PREFETCH_QUEUE; i++) {
+        mshr_t *m = &c->pf_queue[i];
+        if (m->valid && m->ready <= now) {
+            cache_place_prefetch(c, m->block << c->block_bits);
+            m->valid = false;
         }
-        if (set[i].last_used < last_used) {
-            last_used = set[i].last_used;
-            lru_idx = i;
+    }
+    if (busy) {
+        c->mshr_busy_cycles++;
+        c->mshr_occupancy += busy;
+        if (busy > c->mshr_peak)
+            c->mshr_peak = busy;
+    }
+}
+
+/* Finish everything in flight at once, keeping the contents, for a
+ * timing model that restarts from here (after functional warming, say). */
+void cache_settle(cache_t *c)
+{
+    uint64_t now = c->now;
+    cache_tick(c, UINT64_MAX);
+    c->now = now;
+    c->waiting = false;
+    c->cycles = 0;
+    c->fill_pending = c->fill_dirty = false;
+    c->ready = c->replay = false;
+    for (int i = 0; i < c->wbuf_size; i++)
+        c->wbuf[i] = 0;
+    if (c->channel)
+        c->channel->busy_until = 0;
+}
+
+void cache_clear_stats(cache_t *c)
+{
+    c->accesses = c->misses = 0;
+    c->writebacks = c->wbuf_stalls = 0;
+    c->mshr_merges = c->mshr_full = 0;
+    c->mshr_busy_cycles = c->mshr_occupancy = 0;
+    c->mshr_peak = 0;
+    if (c->prefetcher)
+        c->prefetcher->issued = c->prefetcher->useful = c->prefetcher->late = 0;
+    if (c->channel)
+        c->channel->writes = c->channel->stall_cycles = 0;
+    c->coherence_misses = c->invalidations = c->upgrades = c->transfers = 0;
+}
+
+/* The wait started by cache_update for addr is over. */
+void cache_complete(cache_t *c, uint64_t addr)
+{
+    if (c->fill_pending) {
+        int way = cache_place(c, addr);
+        if (c->fill_dirty)
+            c->dirty[(addr >> c->block_bits) & c->set_mask] |= 1ULL << way;
+    }
+    c->fill_pending = false;
+    c->fill_dirty = false;
+    c->replay = true;
+    c->ready = true;
+    c->ready_block = addr >> c->block_bits;
+}
+
+/* install addr's block and return its way */
+static int cache_place(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    uint64_t tag = addr >> c->tag_shift;
+
+    /* the callers may set the block dirty next */
+    cache_changed(c, set_idx);
+    int way = cache_find(c, set_idx, tag);
+    if (way >= 0)
+        return way;
+
+    uint64_t all = c->num_ways == 64 ? ~0ULL : (1ULL << c->num_ways) - 1;
+    uint64_t invalid = ~c->valid[set_idx] & all;
+
+    way = invalid ? __builtin_ctzll(invalid) : repl_victim(c->repl, set_idx);
+    if (c->dirty[set_idx] & (1ULL << way)) {
+        uint64_t victim = c->tags[(uint64_t)set_idx * c->way_stride + way];
+        c->writebacks++;
+        cache_write_below(c, (victim << c->tag_shift) | ((uint64_t)set_idx << c->block_bits),
+                          c->now);
+        c->dirty[set_idx] &= ~(1ULL << way);
+    }
+
+    c->tags[(uint64_t)set_idx * c->way_stride + way] = tag;
+    c->valid[set_idx] |= 1ULL << way;
+    if (c->prefetched)
+        c->prefetched[set_idx] &= ~(1ULL << way);
+    if (c->invalidated)
+        c->invalidated[set_idx] &= ~(1ULL << way);
+    repl_fill(c->repl, set_idx, way);
+    return way;
+}
+
+int cache_snoop_read(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    int way = cache_find(c, set_idx, addr >> c->tag_shift);
+    if (way < 0)
+        return -1;
+    if (!(c->dirty[set_idx] & (1ULL << way)))
+        return 0;
+    /* M to S: the block goes to the reader and back below */
+    cache_changed(c, set_idx);
+    c->writebacks++;
+    cache_write_below(c, addr, c->now);
+    c->dirty[set_idx] &= ~(1ULL << way);
+    return 1;
+}
+
+int cache_snoop_write(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    int way = cache_find(c, set_idx, addr >> c->tag_shift);
+    if (way < 0)
+        return -1;
+    uint64_t bit = 1ULL << way;
+    int modified = (c->dirty[set_idx] & bit) != 0;
+    cache_changed(c, set_idx);
+    c->valid[set_idx] &= ~bit;
+    c->dirty[set_idx] &= ~bit;
+    c->invalidated[set_idx] |= bit;
+    if (c->prefetched)
+        c->prefetched[set_idx] &= ~bit;
+    if (c->ready && c->ready_block == addr >> c->block_bits)
+        c->ready = false;
+    c->invalidations++;
+    return modified;
+}
+
+cache_t *cache_snapshot(cache_t *c, cache_t *snap)
+{
+    size_t tags = (size_t)c->num_sets * c->way_stride;
+    size_t words = (c->num_sets + 63) / 64;
+    if (snap && c->changed) {
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t sets = c->changed[w]; sets; sets &= sets - 1) {
+                size_t set_idx = w * 64 + __builtin_ctzll(sets);
+                memcpy(&snap->tags[set_idx * c->way_stride], &c->tags[set_idx * c->way_stride],
+                       c->way_stride * sizeof(uint64_t));
+                snap->valid[set_idx] = c->valid[set_idx];
+                snap->dirty[set_idx] = c->dirty[set_idx];
+            }
+            c->changed[w] = 0;
         }
+        return snap;
     }
 
-    set[lru_idx].tag = tag;
-    set[lru_idx].valid = true;
-    set[lru_idx].last_used = c->accesses;
+    if (snap == NULL) {
+        snap = (cache_t *)calloc(1, sizeof(cache_t));
+        snap->num_sets = c->num_sets;
+        snap->num_ways = c->num_ways;
+        snap->block_size = c->block_size;
+        snap->block_bits = c->block_bits;
+        snap->tag_shift = c->tag_shift;
+        snap->set_mask = c->set_mask;
+        snap->way_stride = c->way_stride;
+        snap->tags = (uint64_t *)calloc(tags, sizeof(uint64_t));
+        snap->valid = (uint64_t *)calloc(c->num_sets, sizeof(uint64_t));
+        snap->dirty = (uint64_t *)calloc(c->num_sets, sizeof(uint64_t));
+    }
+    memcpy(snap->tags, c->tags, tags * sizeof(uint64_t));
+    memcpy(snap->valid, c->valid, c->num_sets * sizeof(uint64_t));
+    memcpy(snap->dirty, c->dirty, c->num_sets * sizeof(uint64_t));
+    if (c->changed == NULL)
+        c->changed = (uint64_t *)calloc(words, sizeof(uint64_t));
+    else
+        memset(c->changed, 0, words * sizeof(uint64_t));
+    return snap;
+}
+
+int cache_holds(cache_t *c, uint64_t addr)
+{
+    int set_idx = (addr >> c->block_bits) & c->set_mask;
+    int way = cache_find(c, set_idx, addr >> c->tag_shift);
+    if (way < 0)
+        return -1;
+    return (c->dirty[set_idx] >> way) & 1;
+}
+
+void cache_insert(cache_t *c, uint64_t addr){
+    cache_place(c, addr);
 }
 
 bool same_block(cache_t *c, uint64_t addr, uint64_t target){
-    int targ_set = (target>> 5) & 0x3F;
-    int curr_set = (addr >> 5) & 0x3F;
-    int targ_tag = target >> 11;
-    int curr_tag = addr >> 11;
-    
-    return (targ_set == curr_set) && (targ_tag == curr_tag);
+    return (addr >> c->block_bits) == (target >> c->block_bits);
+}
+
+void cache_print_stats(cache_t *c, const char *name)
+{
+    double rate = c->accesses ? 100.0 * c->misses / c->accesses : 0.0;
+    printf("%-4s: accesses %8" PRIu64 "  hits %8" PRIu64 "  misses %8" PRIu64
+           "  (%.2f%% miss)\n",
+           name, c->accesses, c->accesses - c->misses, c->misses, rate);
+    if (c->num_mshrs) {
+        double mlp = c->mshr_busy_cycles ?
+            (double)c->mshr_occupancy / c->mshr_busy_cycles : 0.0;
+        printf("      mshr merges %" PRIu64 "  full %" PRIu64
+               "  peak %d  avg in flight %.2f\n",
+               c->mshr_merges, c->mshr_full, c->mshr_peak, mlp);
+    }
+    if (c->writebacks || c->wbuf_stalls) {
+        printf("      writebacks %" PRIu64 "  write buffer stall cycles %" PRIu64 "\n",
+               c->writebacks, c->wbuf_stalls);
+    }
+    if (c->prefetcher) {
+        prefetcher_t *p = c->prefetcher;
+        printf("      prefetch %s  issued %" PRIu64 "  useful %" PRIu64
+               "  late %" PRIu64 "\n",
+               prefetch_name(p->kind), p->issued, p->useful, p->late);
+    }
+    if (c->bus) {
+        printf("      coherence misses %" PRIu64 "  invalidations %" PRIu64
+               "  upgrades %" PRIu64 "  transfers %" PRIu64 "\n",
+               c->coherence_misses, c->invalidations, c->upgrades, c->transfers);
+    }
+}
+
+void cache_print_channel(mem_channel_t *channel)
+{
+    printf("MEM : writes %8" PRIu64 "  miss cycles waiting on writes %" PRIu64 "\n",
+           channel->writes, channel->stall_cycles);
 }
@@ -9,30 +9,143 @@
 
 #include <stdint.h>
 #include "stdbool.h"
+#include "repl.h"
+#include "prefetch.h"
 
+#define PREFETCH_QUEUE 16     /* prefetches in flight per cache */
+
+/* miss status holding register: one block fill in flight */
 typedef struct {
     bool valid;
-    uint64_t tag;
-    uint64_t last_used; 
-} cache_block_t;
+    bool dirty;             /* a store merged into the miss */
+    uint64_t block;
+    uint64_t ready;         /* cycle the fill arrives */
+} mshr_t;
+
+/* The path to memory. Writebacks and buffered writes occupy it, and a
+ * miss that reaches memory queues behind them. */
+typedef struct {
+    int write_cycles;       /* channel time per block written */
+    uint64_t busy_until;
+    uint64_t writes;
+    uint64_t stall_cycles;  /* cycles misses spent waiting for the channel */
+} mem_channel_t;
 
-typedef struct
+typedef struct cache
 {
     int num_sets;
     int num_ways;
+    int block_size;
     uint64_t accesses;
     uint64_t misses;
     int cycles;
 
+    /* geometry, precomputed by cache_new */
+    int block_bits;
+    int tag_shift;
+    uint64_t set_mask;
+
+    /* cycles an access waits on a hit, and on a miss when there is no
+     * next level to go to */
+    int hit_latency;
+    int miss_latency;
+
+    /* next level of the hierarchy, NULL for memory */
+    struct cache *next;
+
     bool waiting;
+    bool fill_pending;      /* the current wait ends with a fill */
+    bool fill_dirty;        /* ... of a block a store is writing */
+    uint64_t fill_block;
+    bool ready;             /* ready_block is held in the line buffer */
+    bool replay;            /* the access that waited is about to retry */
+    uint64_t ready_block;
+
+    /* tag store: way_stride tags per set, one valid bitmask per set */
+    int way_stride;
+    uint64_t *tags;
+    uint64_t *valid;
+    repl_t *repl;
+
+    /* write policy; a write buffer of wbuf_size entries holds the
+     * cycle each write it has accepted finishes draining */
+    bool write_back;
+    bool write_allocate;
+    uint64_t *dirty;
+    int wbuf_size;
+    uint64_t *wbuf;
+    mem_channel_t *channel;     /* NULL for a free path to memory */
+    uint64_t writebacks;
+    uint64_t wbuf_stalls;       /* cycles stores waited for a buffer entry */
+
+    /* outstanding misses, none for a blocking cache */
+    int num_mshrs;
+    mshr_t *mshrs;
+    uint64_t mshr_merges;       /* misses to a block already in flight */
+    uint64_t mshr_full;         /* misses that found every MSHR busy */
+    uint64_t mshr_busy_cycles;  /* cycles with at least one miss in flight */
+    uint64_t mshr_occupancy;    /* sum of misses in flight over those cycles */
+    int mshr_peak;
+
+    /* prefetching: blocks in flight, and per set the ways holding a
+     * prefetched block no demand access has touched yet */
+    prefetcher_t *prefetcher;
+    mshr_t pf_queue[PREFETCH_QUEUE];
+    uint64_t *prefetched;
+
+    /* MESI between the cores' L1Ds, see coherence.h; NULL bus for one
+     * core. Ways a peer's write invalidated keep their tags so the
+     * next miss to the block counts as a coherence miss. */
+    struct coherence *bus;
+    int core;
+    uint64_t *invalidated;
+    uint64_t coherence_misses;
+    uint64_t invalidations;     /* copies peers' writes took away */
+    uint64_t upgrades;          /* write hits that invalidated peers' copies */
+    uint64_t transfers;         /* misses served by a peer's modified block */
+
+    /* sets changed since the last cache_snapshot, one bit each; NULL
+     * until there is a snapshot */
+    uint64_t *changed;
 
-    cache_block_t **sets;
+    uint64_t now;               /* cycle of the last cache_tick */
 } cache_t;
 
-cache_t *cache_new(int sets, int ways);
+cache_t *cache_new(int block_size, int sets, int ways, int hit_latency, int miss_latency,
+                   repl_policy_t policy);
 void cache_destroy(cache_t *c);
-int cache_update(cache_t *c, uint64_t addr);
+int cache_update(cache_t *c, uint64_t addr, uint64_t pc);
+int cache_write(cache_t *c, uint64_t addr, uint64_t pc);
+void cache_complete(cache_t *c, uint64_t addr);
 void cache_insert(cache_t *c, uint64_t addr);
 bool same_block(cache_t *c, uint64_t addr, uint64_t target);
+int cache_miss_penalty(cache_t *c, uint64_t addr);
+/* The levels below c see a miss, or a block written back, at cycle
+ * now; a parallel run replays its cores' traffic through this. */
+void cache_below(cache_t *c, uint64_t addr, uint64_t now, bool write);
+void cache_set_write_policy(cache_t *c, bool write_back, bool write_allocate,
+                            int wbuf_size);
+void cache_alloc_mshrs(cache_t *c, int count);
+void cache_set_prefetcher(cache_t *c, prefetch_kind_t kind, int degree);
+bool cache_prefetch_block(cache_t *c, uint64_t addr);
+int cache_issue(cache_t *c, uint64_t addr, uint64_t pc, uint64_t now, bool write);
+void cache_tick(cache_t *c, uint64_t now);
+void cache_settle(cache_t *c);
+void cache_clear_stats(cache_t *c);
+void cache_print_stats(cache_t *c, const char *name);
+void cache_print_channel(mem_channel_t *channel);
+void cache_checkpoint(cache_t *c, ckpt_t *ck);
+/* a peer reads or writes addr's block: -1 if c doesn't hold it, else
+ * whether c held it modified. A read leaves c's copy clean, a write
+ * invalidates it. */
+int cache_snoop_read(cache_t *c, uint64_t addr);
+int cache_snoop_write(cache_t *c, uint64_t addr);
+/* Copy c's tags into snap (a new one for NULL) for another thread to
+ * look up with cache_holds while c moves on; free it with
+ * cache_destroy. After the first copy only the sets c has changed
+ * since are copied, so snap must be the one c was last copied into.
+ * cache_holds answers as the snoops do, without changing anything. */
+cache_t *cache_snapshot(cache_t *c, cache_t *snap);
+int cache_holds(cache_t *c, uint64_t addr);
 
 #endif
@@ -0,0 +1,208 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "ckpt.h"
+#include "config.h"
+#include "mem.h"
+#include "pipe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CKPT_MAGIC      "ARMCKPT"
+#define CKPT_NAME       16
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t config;        /* config_hash() of the simulator that saved it */
+} ckpt_header_t;
+
+typedef enum { CKPT_SAVE, CKPT_CHECK, CKPT_LOAD } ckpt_mode_t;
+
+struct ckpt {
+    ckpt_mode_t mode;
+    FILE *out;
+    const uint8_t *map;     /* the file, when checking or loading */
+    size_t size;
+    size_t pos;
+    const char *section;
+    bool failed;
+};
+
+bool ckpt_saving(ckpt_t *ck)
+{
+    return ck->mode == CKPT_SAVE;
+}
+
+bool ckpt_loading(ckpt_t *ck)
+{
+    return ck->mode == CKPT_LOAD;
+}
+
+static void ckpt_fail(ckpt_t *ck, const char *what)
+{
+    if (!ck->failed)
+        printf("Error: checkpoint %s: %s\n", ck->section ? ck->section : "header", what);
+    ck->failed = true;
+}
+
+/* bytes the next read may take, NULL past the end */
+static const uint8_t *ckpt_take(ckpt_t *ck, size_t size)
+{
+    if (ck->failed || size > ck->size - ck->pos) {
+        ckpt_fail(ck, "file is truncated");
+        return NULL;
+    }
+    const uint8_t *p = ck->map + ck->pos;
+    ck->pos += size;
+    return p;
+}
+
+/* meta data is read in when checking too */
+static void ckpt_io(ckpt_t *ck, void *data, size_t size, bool meta)
+{
+    if (size == 0)
+        return;
+    if (ck->mode == CKPT_SAVE) {
+        if (!ck->failed && fwrite(data, 1, size, ck->out) != size)
+            ckpt_fail(ck, "write failed");
+        ck->pos += size;
+        return;
+    }
+    const uint8_t *p = ckpt_take(ck, size);
+    if (p && (meta || ck->mode == CKPT_LOAD))
+        memcpy(data, p, size);
+}
+
+void ckpt_raw(ckpt_t *ck, void *data, size_t size)
+{
+    ckpt_io(ck, data, size, false);
+}
+
+void ckpt_align(ckpt_t *ck, size_t alignment)
+{
+    static const uint8_t zero[MEM_PAGE_SIZE];
+    size_t pad = (alignment - ck->pos % alignment) % alignment;
+    if (ck->mode == CKPT_SAVE)
+        ckpt_raw(ck, (void *)zero, pad);
+    else
+        ckpt_take(ck, pad);
+}
+
+void ckpt_section(ckpt_t *ck, const char *name)
+{
+    char field[CKPT_NAME] = { 0 };
+    strncpy(field, name, CKPT_NAME - 1);
+    if (ck->mode == CKPT_SAVE) {
+        ck->section = name;
+        ckpt_raw(ck, field, CKPT_NAME);
+        return;
+    }
+    const uint8_t *p = ckpt_take(ck, CKPT_NAME);
+    if (p && memcmp(p, field, CKPT_NAME) != 0)
+        ckpt_fail(ck, "sections are out of order");
+    ck->section = name;
+}
+
+static void ckpt_sized(ckpt_t *ck, void *data, size_t size, bool meta)
+{
+    uint64_t stored = size;
+    ckpt_io(ck, &stored, sizeof(stored), true);
+    if (stored != size) {
+        ckpt_fail(ck, "state is a different size here");
+        return;
+    }
+    ckpt_io(ck, data, size, meta);
+}
+
+void ckpt_blob(ckpt_t *ck, void *data, size_t size)
+{
+    ckpt_sized(ck, data, size, false);
+}
+
+void ckpt_meta(ckpt_t *ck, void *data, size_t size)
+{
+    ckpt_sized(ck, data, size, true);
+}
+
+bool ckpt_failed(ckpt_t *ck)
+{
+    return ck->failed;
+}
+
+void ckpt_error(ckpt_t *ck, const char *what)
+{
+    ckpt_fail(ck, what);
+}
+
+static void ckpt_state(ckpt_t *ck)
+{
+    pipe_checkpoint(ck);
+    mem_checkpoint(ck);
+}
+
+int ckpt_save(const char *path)
+{
+    ckpt_t ck = { .mode = CKPT_SAVE };
+    if ((ck.out = fopen(path, "wb")) == NULL) {
+        printf("Error: can't open %s\n", path);
+        return -1;
+    }
+
+    ckpt_header_t header = { CKPT_MAGIC, CKPT_VERSION, 0, config_hash() };
+    ckpt_raw(&ck, &header, sizeof(header));
+    ckpt_state(&ck);
+    if (fclose(ck.out) != 0 && !ck.failed)
+        ckpt_fail(&ck, "write failed");
+    return ck.failed ? -1 : 0;
+}
+
+int ckpt_restore(const char *path)
+{
+    ckpt_t ck = { .mode = CKPT_CHECK };
+    FILE *in = fopen(path, "rb");
+    struct stat st;
+    if (in == NULL || fstat(fileno(in), &st) != 0) {
+        printf("Error: can't open %s\n", path);
+        if (in)
+            fclose(in);
+        return -1;
+    }
+    ck.size = st.st_size;
+    /* pages are copied straight out of the mapping */
+    ck.map = ck.size ? mmap(NULL, ck.size, PROT_READ, MAP_PRIVATE, fileno(in), 0) : MAP_FAILED;
+    fclose(in);
+    if (ck.map == MAP_FAILED) {
+        printf("Error: can't map %s\n", path);
+        return -1;
+    }
+
+    ckpt_header_t header;
+    ckpt_io(&ck, &header, sizeof(header), true);
+    if (!ck.failed && memcmp(header.magic, CKPT_MAGIC, sizeof(header.magic)) != 0)
+        ckpt_fail(&ck, "not a checkpoint file");
+    else if (!ck.failed && header.version != CKPT_VERSION)
+        ckpt_fail(&ck, "written by a different version of the simulator");
+    else if (!ck.failed && header.config != config_hash())
+        ckpt_fail(&ck, "taken with different options");
+
+    /* a dry run first, so a bad file is rejected before anything has
+     * been overwritten */
+    if (!ck.failed) {
+        ckpt_state(&ck);
+        ck.mode = CKPT_LOAD;
+        ck.pos = sizeof(header);
+        ck.section = NULL;
+        if (!ck.failed)
+            ckpt_state(&ck);
+    }
+    munmap((void *)ck.map, ck.size);
+    return ck.failed ? -1 : 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Checkpoints. Each module has a X_checkpoint function that hands its
+ * state to ckpt_blob piece by piece; saving writes the pieces out, and
+ * restoring runs the same function and reads them back in, so the two
+ * cannot drift apart. A checkpoint restores only into a simulator
+ * started with the same options.
+ *
+ * The file is a header and then the blobs, each with its size, so a
+ * mismatch is caught where it happens. Guest pages come last, aligned
+ * to the page size; restore maps the file and copies them in.
+ */
+#ifndef _CKPT_H_
+#define _CKPT_H_
+
+#include <stddef.h>
+#include "stdbool.h"
+
+#define CKPT_VERSION 1
+
+typedef struct ckpt ckpt_t;
+
+bool ckpt_saving(ckpt_t *ck);
+bool ckpt_loading(ckpt_t *ck);
+/* names the blobs that follow, for error messages and as a check */
+void ckpt_section(ckpt_t *ck, const char *name);
+void ckpt_blob(ckpt_t *ck, void *data, size_t size);
+#define ckpt_var(ck, v) ckpt_blob(ck, &(v), sizeof(v))
+/* a blob describing what follows (a count, say), read in even on the
+ * dry run restore makes first; it must go into a local */
+void ckpt_meta(ckpt_t *ck, void *data, size_t size);
+/* no size, for page data */
+void ckpt_raw(ckpt_t *ck, void *data, size_t size);
+void ckpt_align(ckpt_t *ck, size_t alignment);
+/* for checks a module makes of its own; failures stop the restore */
+void ckpt_error(ckpt_t *ck, const char *what);
+bool ckpt_failed(ckpt_t *ck);
+
+/* 0 on success. restore checks the whole file against this simulator
+ * before changing anything. */
+int ckpt_save(const char *path);
+int ckpt_restore(const char *path);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "coherence.h"
+#include "config.h"
+#include "core.h"
+#include "parallel.h"
+#include <stdlib.h>
+
+static coherence_t bus;
+
+void coherence_attach(cache_t *c, int core)
+{
+    c->bus = &bus;
+    c->core = core;
+    c->invalidated = calloc(c->num_sets, sizeof(uint64_t));
+    bus.l1d[core] = c;
+}
+
+void coherence_detach(cache_t *c)
+{
+    bus.l1d[c->core] = NULL;
+    c->bus = NULL;
+}
+
+cache_t *coherence_l1d(int core)
+{
+    return bus.l1d[core];
+}
+
+/* a core thread can't reach into its peers; parallel.c carries it over */
+static int coherence_snoop(int core, uint64_t addr, bool write)
+{
+    if (core_threaded)
+        return parallel_snoop(core, addr, write);
+    return write ? cache_snoop_write(bus.l1d[core], addr) : cache_snoop_read(bus.l1d[core], addr);
+}
+
+int coherence_read(cache_t *c, uint64_t addr)
+{
+    bool modified = false;
+    for (int i = 0; i < config.cores; i++) {
+        cache_t *peer = bus.l1d[i];
+        if (peer && peer != c && coherence_snoop(i, addr, false) > 0)
+            modified = true;
+    }
+    if (!modified)
+        return -1;
+    c->transfers++;
+    return config.transfer_latency;
+}
+
+int coherence_write(cache_t *c, uint64_t addr, bool hit)
+{
+    int held = -1;
+    for (int i = 0; i < config.cores; i++) {
+        cache_t *peer = bus.l1d[i];
+        if (!peer || peer == c)
+            continue;
+        int snooped = coherence_snoop(i, addr, true);
+        if (snooped > held)
+            held = snooped;
+    }
+    if (hit) {
+        if (held < 0)
+            return 0;
+        c->upgrades++;
+        return config.coherence_latency;
+    }
+    if (held > 0) {
+        c->transfers++;
+        return config.transfer_latency;
+    }
+    return -1;
+}
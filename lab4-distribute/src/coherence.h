@@ -0,0 +1,37 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * MESI coherence between the cores' L1Ds over a snooping bus. Memory
+ * itself is shared and always current, so the protocol only costs
+ * time. The states are implicit in the caches: a valid line no other
+ * L1D holds is M when dirty and E otherwise, and a line another L1D
+ * also holds is S.
+ */
+#ifndef _COHERENCE_H_
+#define _COHERENCE_H_
+
+#include "cache.h"
+
+#define MAX_CORES 64
+
+typedef struct coherence {
+    cache_t *l1d[MAX_CORES];    /* NULL once a core has halted */
+} coherence_t;
+
+void coherence_attach(cache_t *c, int core);
+void coherence_detach(cache_t *c);
+/* core's L1D, NULL once it has halted */
+cache_t *coherence_l1d(int core);
+
+/* A read miss in c: peers holding the block modified write it back.
+ * Returns the cycles to take it from a peer, or -1 to go below. */
+int coherence_read(cache_t *c, uint64_t addr);
+
+/* A write in c invalidates every peer's copy. Returns the cycles a hit
+ * waits for that (0 when no peer had one), and for a miss the cycles
+ * to take the block from a peer that had it modified, or -1. */
+int coherence_write(cache_t *c, uint64_t addr, bool hit);
+
+#endif
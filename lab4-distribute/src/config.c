@@ -0,0 +1,287 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "config.h"
+#include "shell.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+sim_config_t config = {
+    .mem_sparse = 0,
+    .mem_data_size = MEM_DATA_SIZE,
+    .mem_stack_size = MEM_STACK_SIZE,
+
+    .cores = 1,
+    .core = "inorder",
+    .width = 1,
+    .dcache_ports = 1,
+    .rob_size = 64,
+    .iq_size = 32,
+    .lsq_size = 32,
+
+    .bp = "gshare",
+    .bp_history = 8,
+    .bp_table_bits = 8,
+    .btb_sets = 256,
+    .btb_ways = 4,
+    .btb_tag_bits = 16,
+    .ittage = 1,
+    .ftq = 0,
+
+    .icache_block_size = 32,
+    .icache_sets = 64,
+    .icache_ways = 4,
+    .icache_hit_latency = 0,
+    .icache_miss_latency = 50,
+
+    .dcache_block_size = 32,
+    .dcache_sets = 256,
+    .dcache_ways = 8,
+    .dcache_hit_latency = 0,
+    .dcache_miss_latency = 50,
+    .icache_repl = "lru",
+    .dcache_repl = "lru",
+    .dcache_mshrs = 0,
+    .dcache_write_back = 1,
+    .dcache_write_allocate = 1,
+    .write_buffer = 8,
+    .mem_write_cycles = 0,
+    .icache_prefetch = "none",
+    .dcache_prefetch = "none",
+    .prefetch_degree = 1,
+
+    .l2_block_size = 64,
+    .l2_sets = 0,
+    .l2_ways = 8,
+    .l2_hit_latency = 10,
+    .l2_miss_latency = 50,
+    .l2_repl = "lru",
+
+    .llc_block_size = 64,
+    .llc_sets = 0,
+    .llc_ways = 16,
+    .llc_hit_latency = 30,
+    .llc_miss_latency = 50,
+    .llc_repl = "lru",
+
+    .coherence_latency = 10,
+    .transfer_latency = 20,
+
+    .parallel = 0,
+    .parallel_quantum = 1000,
+    .parallel_deterministic = 0,
+
+    .simpoint_maxk = 10,
+    .simpoint_dims = 15,
+    .simpoint_seed = 1,
+    .simpoint_warmup = 100000,
+
+    .sample_period = 100000,
+    .sample_warmup = 2000,
+    .sample_size = 1000,
+
+    .trace = "",
+    .trace_file = "-",
+};
+
+typedef enum { CONFIG_INT, CONFIG_U64, CONFIG_STR } config_kind_t;
+
+typedef struct {
+    const char *name;
+    config_kind_t kind;
+    size_t offset;
+    const char *help;
+} config_option_t;
+
+#define OPTION(kind, field, help) \
+    { #field, kind, offsetof(sim_config_t, field), help }
+
+static const config_option_t OPTIONS[] = {
+    OPTION(CONFIG_INT, mem_sparse, "back memory with demand-zero pages (0/1)"),
+    OPTION(CONFIG_U64, mem_data_size, "bytes in the data region (K/M/G suffix)"),
+    OPTION(CONFIG_U64, mem_stack_size, "bytes in the stack region (K/M/G suffix)"),
+
+    OPTION(CONFIG_INT, cores, "cores running the program on shared memory; each finds its number in X0"),
+    OPTION(CONFIG_STR, core, "timing model: inorder or ooo"),
+    OPTION(CONFIG_INT, width, "instructions fetched and issued per cycle; above 1 selects the wide in-order pipeline"),
+    OPTION(CONFIG_INT, dcache_ports, "dcache accesses per cycle in the wide and out-of-order cores"),
+    OPTION(CONFIG_INT, rob_size, "out-of-order core: reorder buffer entries"),
+    OPTION(CONFIG_INT, iq_size, "out-of-order core: issue queue entries"),
+    OPTION(CONFIG_INT, lsq_size, "out-of-order core: load/store queue entries"),
+
+    OPTION(CONFIG_STR, bp, "direction predictor: bimodal, gshare, tournament, tage, perceptron"),
+    OPTION(CONFIG_INT, bp_history, "global history bits for gshare, tournament and perceptron"),
+    OPTION(CONFIG_INT, bp_table_bits, "log2 of the bimodal/gshare/chooser table size"),
+    OPTION(CONFIG_INT, btb_sets, "BTB sets"),
+    OPTION(CONFIG_INT, btb_ways, "BTB associativity"),
+    OPTION(CONFIG_INT, btb_tag_bits, "partial tag bits per BTB entry"),
+    OPTION(CONFIG_INT, ittage, "predict BR targets with ITTAGE (0/1)"),
+    OPTION(CONFIG_INT, ftq, "fetch target queue entries; the icache prefetches from it (0 = off)"),
+
+    OPTION(CONFIG_INT, icache_block_size, "icache block size in bytes"),
+    OPTION(CONFIG_INT, icache_sets, "icache sets"),
+    OPTION(CONFIG_INT, icache_ways, "icache associativity"),
+    OPTION(CONFIG_INT, icache_hit_latency, "extra cycles an icache hit stalls fetch"),
+    OPTION(CONFIG_INT, icache_miss_latency, "cycles an icache miss stalls fetch with no L2/LLC"),
+    OPTION(CONFIG_INT, dcache_block_size, "dcache block size in bytes"),
+    OPTION(CONFIG_INT, dcache_sets, "dcache sets"),
+    OPTION(CONFIG_INT, dcache_ways, "dcache associativity"),
+    OPTION(CONFIG_INT, dcache_hit_latency, "extra cycles a dcache hit stalls memory"),
+    OPTION(CONFIG_INT, dcache_miss_latency, "cycles a dcache miss stalls memory with no L2/LLC"),
+    OPTION(CONFIG_STR, icache_repl, "icache replacement: lru, tree-plru, bit-plru, random, srrip, drrip"),
+    OPTION(CONFIG_STR, dcache_repl, "dcache replacement policy"),
+    OPTION(CONFIG_INT, dcache_mshrs, "outstanding dcache misses, 0 for a blocking dcache"),
+    OPTION(CONFIG_INT, dcache_write_back, "1 for a write-back dcache, 0 for write-through"),
+    OPTION(CONFIG_INT, dcache_write_allocate, "1 to fill the dcache on a store miss"),
+    OPTION(CONFIG_INT, write_buffer, "dcache write buffer entries"),
+    OPTION(CONFIG_INT, mem_write_cycles, "cycles a block write holds the memory channel"),
+    OPTION(CONFIG_STR, icache_prefetch, "icache prefetcher: none, next-line, stride, stream"),
+    OPTION(CONFIG_STR, dcache_prefetch, "dcache prefetcher"),
+    OPTION(CONFIG_INT, prefetch_degree, "blocks each prefetcher trigger asks for"),
+
+    OPTION(CONFIG_INT, l2_block_size, "L2 block size in bytes"),
+    OPTION(CONFIG_INT, l2_sets, "L2 sets, 0 for no L2"),
+    OPTION(CONFIG_INT, l2_ways, "L2 associativity"),
+    OPTION(CONFIG_INT, l2_hit_latency, "cycles an L2 hit adds to an L1 miss"),
+    OPTION(CONFIG_INT, l2_miss_latency, "cycles an L2 miss adds when there is no LLC"),
+    OPTION(CONFIG_STR, l2_repl, "L2 replacement policy"),
+    OPTION(CONFIG_INT, llc_block_size, "LLC block size in bytes"),
+    OPTION(CONFIG_INT, llc_sets, "LLC sets, 0 for no LLC"),
+    OPTION(CONFIG_INT, llc_ways, "LLC associativity"),
+    OPTION(CONFIG_INT, llc_hit_latency, "cycles an LLC hit adds"),
+    OPTION(CONFIG_INT, llc_miss_latency, "cycles an LLC miss adds (memory latency)"),
+    OPTION(CONFIG_STR, llc_repl, "LLC replacement policy"),
+
+    OPTION(CONFIG_INT, coherence_latency, "cycles a store waits to invalidate other cores' copies"),
+    OPTION(CONFIG_INT, transfer_latency, "cycles a miss waits for another core's modified block"),
+
+    OPTION(CONFIG_INT, parallel, "1 to simulate each core on its own host thread"),
+    OPTION(CONFIG_INT, parallel_quantum, "parallel: cycles the cores run between barriers; sharing shows up at most once per quantum, so 1 for accuracy"),
+    OPTION(CONFIG_INT, parallel_deterministic, "parallel: 1 to exchange snoops and stores only at barriers, so runs repeat exactly"),
+
+    OPTION(CONFIG_INT, simpoint_maxk, "simpoint: most phases (clusters) to choose"),
+    OPTION(CONFIG_INT, simpoint_dims, "simpoint: dimensions of the projected basic block vectors"),
+    OPTION(CONFIG_INT, simpoint_seed, "simpoint: seed for the projection and k-means"),
+    OPTION(CONFIG_U64, simpoint_warmup, "simpoint: instructions warming caches and predictor before each point"),
+
+    OPTION(CONFIG_U64, sample_period, "sample: instructions from the start of one sample to the next"),
+    OPTION(CONFIG_U64, sample_warmup, "sample: instructions simulated in detail before each measurement"),
+    OPTION(CONFIG_U64, sample_size, "sample: instructions measured per sample"),
+
+    OPTION(CONFIG_STR, trace, "trace categories: cycle,fetch,decode,exec,mem,wb,bp,cache or all (sim-trace build), or pipe for the binary pipeline trace"),
+    OPTION(CONFIG_STR, trace_file, "where the trace goes, - for stdout"),
+};
+#define NUM_OPTIONS (sizeof(OPTIONS) / sizeof(OPTIONS[0]))
+
+static int parse_number(const char *text, uint64_t *out)
+{
+    char *end;
+    uint64_t value = strtoull(text, &end, 0);
+    switch (*end) {
+        case 'G': case 'g': value <<= 10; /* fall through */
+        case 'M': case 'm': value <<= 10; /* fall through */
+        case 'K': case 'k': value <<= 10; end++; break;
+    }
+    if (end == text || *end != '\0')
+        return 0;
+    *out = value;
+    return 1;
+}
+
+static int set_option(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return 0;
+
+    for (int i = 0; i < NUM_OPTIONS; i++) {
+        const config_option_t *opt = &OPTIONS[i];
+        if (strlen(opt->name) != eq - arg || strncmp(opt->name, arg, eq - arg))
+            continue;
+
+        void *field = (char *)&config + opt->offset;
+        if (opt->kind == CONFIG_STR) {
+            *(const char **)field = eq + 1;
+            return 1;
+        }
+
+        uint64_t value;
+        if (!parse_number(eq + 1, &value))
+            return 0;
+        if (opt->kind == CONFIG_INT)
+            *(int *)field = value;
+        else
+            *(uint64_t *)field = value;
+        return 1;
+    }
+    return 0;
+}
+
+int config_parse(int argc, char *argv[])
+{
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (!set_option(argv[i] + 1)) {
+            printf("Error: bad option %s\n", argv[i]);
+            config_usage();
+            exit(1);
+        }
+    }
+    argv[kept] = NULL;
+    return kept;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ p[i]) * 0x100000001B3ULL;      /* FNV-1a */
+    return h;
+}
+
+/* tracing, sampling and host threads leave the machine alone */
+static bool shapes_machine(const char *name)
+{
+    static const char *OTHERS[] = { "trace", "simpoint_", "sample_", "parallel" };
+    for (int i = 0; i < sizeof(OTHERS) / sizeof(OTHERS[0]); i++) {
+        if (strncmp(name, OTHERS[i], strlen(OTHERS[i])) == 0)
+            return false;
+    }
+    return true;
+}
+
+uint64_t config_hash()
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < NUM_OPTIONS; i++) {
+        const config_option_t *opt = &OPTIONS[i];
+        const void *field = (const char *)&config + opt->offset;
+        if (!shapes_machine(opt->name))
+            continue;
+        h = hash_bytes(h, opt->name, strlen(opt->name) + 1);
+        if (opt->kind == CONFIG_STR)
+            h = hash_bytes(h, *(const char **)field, strlen(*(const char **)field) + 1);
+        else if (opt->kind == CONFIG_INT)
+            h = hash_bytes(h, field, sizeof(int));
+        else
+            h = hash_bytes(h, field, sizeof(uint64_t));
+    }
+    return h;
+}
+
+void config_usage()
+{
+    printf("Options (-name=value, before the program files):\n");
+    for (int i = 0; i < NUM_OPTIONS; i++)
+        printf("  -%-22s %s\n", OPTIONS[i].name, OPTIONS[i].help);
+}
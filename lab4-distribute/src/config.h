@@ -0,0 +1,88 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Startup configuration. Options are given on the command line ahead
+ * of the program files as -name=value, e.g. -mem_data_size=4G.
+ */
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdint.h>
+
+typedef struct {
+    /* guest memory */
+    int mem_sparse;
+    uint64_t mem_data_size;
+    uint64_t mem_stack_size;
+
+    /* pipeline */
+    int cores;                  /* cores sharing memory; core i starts with i in X0 */
+    const char *core;           /* "inorder" or "ooo" */
+    int width;                  /* instructions per cycle, 1 for the scalar pipeline */
+    int dcache_ports;           /* dcache accesses per cycle in the wide and OoO cores */
+    int rob_size, iq_size, lsq_size;
+
+    /* branch prediction */
+    const char *bp;
+    int bp_history, bp_table_bits;
+    int btb_sets, btb_ways, btb_tag_bits;
+    int ittage;
+    int ftq;                    /* fetch target queue entries, 0 to couple fetch and prediction */
+
+    /* L1 caches */
+    int icache_block_size, icache_sets, icache_ways;
+    int icache_hit_latency, icache_miss_latency;
+    int dcache_block_size, dcache_sets, dcache_ways;
+    int dcache_hit_latency, dcache_miss_latency;
+    const char *icache_repl, *dcache_repl;
+    int dcache_mshrs;           /* 0 for a blocking dcache */
+    int dcache_write_back, dcache_write_allocate;
+    int write_buffer;           /* dcache write buffer entries */
+    int mem_write_cycles;       /* channel cycles per block written to memory */
+    const char *icache_prefetch, *dcache_prefetch;
+    int prefetch_degree;
+
+    /* lower levels, disabled while their set count is 0 */
+    int l2_block_size, l2_sets, l2_ways;
+    int l2_hit_latency, l2_miss_latency;
+    const char *l2_repl;
+    int llc_block_size, llc_sets, llc_ways;
+    int llc_hit_latency, llc_miss_latency;
+    const char *llc_repl;
+
+    /* MESI snooping between the cores' L1Ds */
+    int coherence_latency;      /* bus upgrade: a write hit invalidating other copies */
+    int transfer_latency;       /* a miss served by another core's modified block */
+
+    /* host-parallel multi-core, see parallel.h */
+    int parallel;               /* one host thread per core */
+    int parallel_quantum;       /* cycles the threads run between barriers */
+    int parallel_deterministic; /* cores exchange snoops and stores only at barriers */
+
+    /* SimPoint profiling and simulation, see simpoint.h */
+    int simpoint_maxk;          /* most phases to look for */
+    int simpoint_dims;          /* dimensions the BBVs are projected to */
+    int simpoint_seed;
+    uint64_t simpoint_warmup;   /* instructions of cache and predictor warming per point */
+
+    /* SMARTS sampling, see sample.h */
+    uint64_t sample_period;     /* instructions from one sample to the next */
+    uint64_t sample_warmup;     /* detailed instructions before each measurement */
+    uint64_t sample_size;       /* instructions measured per sample */
+
+    /* tracing, see trace.h */
+    const char *trace;          /* categories, "" for none */
+    const char *trace_file;     /* "-" for stdout */
+} sim_config_t;
+
+extern sim_config_t config;
+
+/* strips recognised options out of argv and returns the new argc */
+int config_parse(int argc, char *argv[]);
+void config_usage();
+/* fingerprint of the options that shape the simulated machine */
+uint64_t config_hash();
+
+#endif
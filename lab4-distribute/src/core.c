@@ -0,0 +1,189 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "core.h"
+#include "coherence.h"
+#include "config.h"
+#include "pipe.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CORE_MAX_VARS 64
+
+typedef struct {
+    void *addr;
+    size_t size;
+    size_t offset;          /* in a core's context */
+} core_var_t;
+
+/* each host thread registers its own copies, in the same order */
+static __thread core_var_t vars[CORE_MAX_VARS];
+static __thread int num_vars;
+static __thread size_t context_size;
+static char *contexts;      /* context_size bytes per core */
+
+static bool running[MAX_CORES];
+static uint64_t retired[MAX_CORES];
+static __thread uint32_t retired_before;    /* stat_inst_retire as this cycle began */
+
+__thread int current_core;
+__thread bool core_threaded;
+
+void core_var(void *addr, size_t size)
+{
+    for (int i = 0; i < num_vars; i++) {
+        if (vars[i].addr == addr)
+            return;
+    }
+    if (num_vars == CORE_MAX_VARS) {
+        printf("Error: more than %d per-core variables\n", CORE_MAX_VARS);
+        exit(-1);
+    }
+    vars[num_vars++] = (core_var_t){ addr, size, context_size };
+    context_size += (size + 7) & ~(size_t)7;
+}
+
+void core_save(int core)
+{
+    char *context = contexts + core * context_size;
+    for (int i = 0; i < num_vars; i++)
+        memcpy(context + vars[i].offset, vars[i].addr, vars[i].size);
+}
+
+void core_load(int core)
+{
+    const char *context = contexts + core * context_size;
+    mem_channel_t channel = pipe.channel;
+    for (int i = 0; i < num_vars; i++)
+        memcpy(vars[i].addr, context + vars[i].offset, vars[i].size);
+    pipe.channel = channel;
+}
+
+void core_init()
+{
+    if (config.cores == 1)
+        return;
+    if (config.cores < 1 || config.cores > MAX_CORES) {
+        printf("Error: cores (%d) must be between 1 and %d\n", config.cores, MAX_CORES);
+        exit(-1);
+    }
+    if (trace_mask & TRACE_PIPE) {
+        printf("Error: -trace=pipe records a single core\n");
+        exit(-1);
+    }
+    if (config.parallel && trace_mask) {
+        printf("Error: tracing needs -parallel=0\n");
+        exit(-1);
+    }
+    if (config.parallel && config.parallel_quantum < 1) {
+        printf("Error: parallel_quantum (%d) must be at least 1\n", config.parallel_quantum);
+        exit(-1);
+    }
+
+    pipe_core_vars();
+    contexts = calloc(config.cores, context_size);
+    core_save(0);
+    running[0] = true;
+
+    /* the others start where core 0 does, with their number in X0 */
+    uint64_t PC = pipe.PC;
+    for (current_core = 1; current_core < config.cores; current_core++) {
+        pipe_init();
+        pipe.PC = PC;
+        pipe.REGS[0] = current_core;
+        core_save(current_core);
+        running[current_core] = true;
+    }
+    current_core = 0;
+    core_load(0);
+    RUN_BIT = TRUE;
+}
+
+void core_switch(int core)
+{
+    if (core == current_core || config.cores == 1)
+        return;
+    core_save(current_core);
+    core_load(core);
+    current_core = core;
+}
+
+bool core_step()
+{
+    retired_before = stat_inst_retire;
+    RUN_BIT = TRUE;
+    pipe_cycle();
+    retired[current_core] += (uint32_t)(stat_inst_retire - retired_before);
+    return RUN_BIT;
+}
+
+void core_cycle()
+{
+    if (config.cores == 1) {
+        pipe_cycle();
+        return;
+    }
+
+    bool any = false;
+    for (int c = 0; c < config.cores; c++) {
+        if (!running[c])
+            continue;
+        core_switch(c);
+        running[c] = core_step();
+        any |= running[c];
+    }
+    RUN_BIT = any;
+}
+
+void core_bind(int core)
+{
+    pipe_core_vars();
+    current_core = core;
+    core_load(core);
+    core_threaded = true;
+}
+
+void core_unbind()
+{
+    core_save(current_core);
+    core_threaded = false;
+}
+
+void core_finish(int core)
+{
+    current_core = core;
+    core_load(core);
+    retired_before = stat_inst_retire;
+    free_pipeline();
+    running[core] = false;
+    core_save(core);
+}
+
+bool core_others_running()
+{
+    for (int c = 0; c < config.cores; c++) {
+        if (c != current_core && running[c])
+            return true;
+    }
+    return false;
+}
+
+bool core_running(int core)
+{
+    return running[core];
+}
+
+void core_print_stats()
+{
+    if (config.cores == 1)
+        return;
+    /* a core halts in the middle of its cycle */
+    uint64_t count = retired[current_core] + (uint32_t)(stat_inst_retire - retired_before);
+    printf("\nCore %d: retired %" PRIu64 " instructions in %u cycles (IPC %.3f)\n",
+           current_core, count, stat_cycles, stat_cycles ? (double)count / stat_cycles : 0.0);
+}
@@ -0,0 +1,56 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Multi-core runs (-cores=N). The timing models keep their state in
+ * globals, so each core has a saved copy of every per-core global and
+ * core_switch swaps one core's copy in. Memory, the predecode cache,
+ * the L2 and LLC and the memory channel are shared. RUN_BIT stays
+ * true while any core runs.
+ *
+ * The per-core globals are __thread: a parallel run (parallel.h) binds
+ * each core to a host thread's own copies instead of switching.
+ */
+#ifndef _CORE_H_
+#define _CORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern __thread int current_core;
+/* on a parallel run's core threads, which leave a core that halts for
+ * core_finish rather than freeing it */
+extern __thread bool core_threaded;
+
+/* Each module names its per-core globals with CORE_VAR in its
+ * X_core_vars function. */
+#define CORE_VAR(x) core_var(&(x), sizeof(x))
+void core_var(void *addr, size_t size);
+
+/* after the program is loaded: give every core a pipeline */
+void core_init();
+void core_switch(int core);
+/* one cycle of every core still running */
+void core_cycle();
+/* true while a core other than the current one runs */
+bool core_others_running();
+bool core_running(int core);
+void core_print_stats();
+
+/* The calling thread's copies take core's saved state, or give the
+ * current core's back. The shared memory channel stays as it is. */
+void core_load(int core);
+void core_save(int core);
+
+/* on a core thread: take core's state into this thread, or put it
+ * back */
+void core_bind(int core);
+void core_unbind();
+/* one cycle of the current core; false once it has halted */
+bool core_step();
+/* print and free a core that halted on its own thread */
+void core_finish(int core);
+
+#endif
@@ -0,0 +1,419 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "dirpred.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint64_t history_mask(int bits)
+{
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+/* saturating counter in [0, max] */
+static inline void counter_train(uint8_t *ctr, bool up, int max)
+{
+    if (up && *ctr < max)
+        (*ctr)++;
+    else if (!up && *ctr > 0)
+        (*ctr)--;
+}
+
+/***************************************************************/
+/* bimodal and gshare: a table of 2-bit counters               */
+/***************************************************************/
+
+typedef struct {
+    dir_predictor_t base;
+    uint64_t mask;
+    uint8_t *pht;
+} counter_pred_t;
+
+static inline uint64_t bimodal_index(counter_pred_t *p, uint64_t PC, uint64_t ghr)
+{
+    return (PC >> 2) & p->mask;
+}
+
+static inline uint64_t gshare_index(counter_pred_t *p, uint64_t PC, uint64_t ghr)
+{
+    return ((PC >> 2) ^ (ghr & history_mask(p->base.history))) & p->mask;
+}
+
+static bool bimodal_predict(dir_predictor_t *d, uint64_t PC, uint64_t ghr)
+{
+    counter_pred_t *p = (counter_pred_t *)d;
+    return p->pht[bimodal_index(p, PC, ghr)] >= 2;
+}
+
+static void bimodal_update(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken)
+{
+    counter_pred_t *p = (counter_pred_t *)d;
+    counter_train(&p->pht[bimodal_index(p, PC, ghr)], taken, 3);
+}
+
+static bool gshare_predict(dir_predictor_t *d, uint64_t PC, uint64_t ghr)
+{
+    counter_pred_t *p = (counter_pred_t *)d;
+    return p->pht[gshare_index(p, PC, ghr)] >= 2;
+}
+
+static void gshare_update(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken)
+{
+    counter_pred_t *p = (counter_pred_t *)d;
+    counter_train(&p->pht[gshare_index(p, PC, ghr)], taken, 3);
+}
+
+static void counter_destroy(dir_predictor_t *d)
+{
+    free(((counter_pred_t *)d)->pht);
+    free(d);
+}
+
+static void counter_checkpoint(dir_predictor_t *d, ckpt_t *ck)
+{
+    counter_pred_t *p = (counter_pred_t *)d;
+    ckpt_blob(ck, p->pht, p->mask + 1);
+}
+
+static dir_predictor_t *counter_new(const char *name, int history, int table_bits,
+                                    bool gshare)
+{
+    counter_pred_t *p = calloc(1, sizeof(counter_pred_t));
+    p->base.name = name;
+    p->base.history = gshare ? history : 0;
+    p->base.predict = gshare ? gshare_predict : bimodal_predict;
+    p->base.update = gshare ? gshare_update : bimodal_update;
+    p->base.destroy = counter_destroy;
+    p->base.checkpoint = counter_checkpoint;
+    p->mask = history_mask(table_bits);
+    p->pht = calloc(1ULL << table_bits, sizeof(uint8_t));
+    return &p->base;
+}
+
+static dir_predictor_t *bimodal_new(int history, int table_bits)
+{
+    return counter_new("bimodal", history, table_bits, false);
+}
+
+static dir_predictor_t *gshare_new(int history, int table_bits)
+{
+    return counter_new("gshare", history, table_bits, true);
+}
+
+/***************************************************************/
+/* tournament: gshare and bimodal with a per-PC chooser        */
+/***************************************************************/
+
+typedef struct {
+    dir_predictor_t base;
+    dir_predictor_t *global, *local;
+    uint64_t mask;
+    uint8_t *chooser;       /* >= 2 trusts gshare */
+} tournament_pred_t;
+
+static bool tournament_predict(dir_predictor_t *d, uint64_t PC, uint64_t ghr)
+{
+    tournament_pred_t *p = (tournament_pred_t *)d;
+    dir_predictor_t *use = p->chooser[(PC >> 2) & p->mask] >= 2 ? p->global : p->local;
+    return use->predict(use, PC, ghr);
+}
+
+static void tournament_update(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken)
+{
+    tournament_pred_t *p = (tournament_pred_t *)d;
+    bool global = p->global->predict(p->global, PC, ghr);
+    bool local = p->local->predict(p->local, PC, ghr);
+    if (global != local)
+        counter_train(&p->chooser[(PC >> 2) & p->mask], global == taken, 3);
+    p->global->update(p->global, PC, ghr, taken);
+    p->local->update(p->local, PC, ghr, taken);
+}
+
+static void tournament_destroy(dir_predictor_t *d)
+{
+    tournament_pred_t *p = (tournament_pred_t *)d;
+    p->global->destroy(p->global);
+    p->local->destroy(p->local);
+    free(p->chooser);
+    free(p);
+}
+
+static void tournament_checkpoint(dir_predictor_t *d, ckpt_t *ck)
+{
+    tournament_pred_t *p = (tournament_pred_t *)d;
+    p->global->checkpoint(p->global, ck);
+    p->local->checkpoint(p->local, ck);
+    ckpt_blob(ck, p->chooser, p->mask + 1);
+}
+
+static dir_predictor_t *tournament_new(int history, int table_bits)
+{
+    tournament_pred_t *p = calloc(1, sizeof(tournament_pred_t));
+    p->base.name = "tournament";
+    p->base.history = history;
+    p->base.predict = tournament_predict;
+    p->base.update = tournament_update;
+    p->base.destroy = tournament_destroy;
+    p->base.checkpoint = tournament_checkpoint;
+    p->global = gshare_new(history, table_bits);
+    p->local = bimodal_new(history, table_bits);
+    p->mask = history_mask(table_bits);
+    p->chooser = calloc(1ULL << table_bits, sizeof(uint8_t));
+    return &p->base;
+}
+
+/***************************************************************/
+/* TAGE: bimodal base plus tagged tables with geometrically    */
+/* longer histories; the longest matching table provides       */
+/***************************************************************/
+
+typedef struct {
+    uint16_t tag;
+    uint8_t ctr;            /* 3-bit, taken from 4 up */
+    uint8_t useful;         /* 2-bit */
+    bool valid;             /* tag 0 is a real tag */
+} tage_entry_t;
+
+typedef struct {
+    dir_predictor_t base;
+    uint8_t bimodal[1 << TAGE_BASE_BITS];
+    tage_entry_t table[TAGE_TABLES][1 << TAGE_TABLE_BITS];
+    uint32_t updates;
+} tage_pred_t;
+
+static const int TAGE_HISTORY[TAGE_TABLES] = { 5, 12, 27, 64 };
+
+/* xor a len-bit history down to bits bits */
+static inline uint64_t fold(uint64_t ghr, int len, int bits)
+{
+    uint64_t h = ghr & history_mask(len), folded = 0;
+    for (; h; h >>= bits)
+        folded ^= h & history_mask(bits);
+    return folded;
+}
+
+static inline int tage_index(uint64_t PC, uint64_t ghr, int t)
+{
+    uint64_t pc = PC >> 2;
+    return (pc ^ (pc >> TAGE_TABLE_BITS) ^ fold(ghr, TAGE_HISTORY[t], TAGE_TABLE_BITS))
+           & history_mask(TAGE_TABLE_BITS);
+}
+
+static inline uint16_t tage_tag(uint64_t PC, uint64_t ghr, int t)
+{
+    uint64_t h = fold(ghr, TAGE_HISTORY[t], TAGE_TAG_BITS) ^
+                 (fold(ghr, TAGE_HISTORY[t], TAGE_TAG_BITS - 1) << 1);
+    return ((PC >> 2) ^ h) & history_mask(TAGE_TAG_BITS);
+}
+
+typedef struct {
+    int provider, alt;      /* table numbers, -1 for the base predictor */
+    tage_entry_t *entry[TAGE_TABLES];
+    bool provider_pred, alt_pred, pred;
+} tage_lookup_t;
+
+static void tage_lookup(tage_pred_t *p, uint64_t PC, uint64_t ghr, tage_lookup_t *l)
+{
+    l->provider = l->alt = -1;
+    for (int t = TAGE_TABLES - 1; t >= 0; t--) {
+        tage_entry_t *e = &p->table[t][tage_index(PC, ghr, t)];
+        l->entry[t] = e;
+        if (!e->valid || e->tag != tage_tag(PC, ghr, t))
+            continue;
+        if (l->provider < 0)
+            l->provider = t;
+        else if (l->alt < 0)
+            l->alt = t;
+    }
+
+    bool base = p->bimodal[(PC >> 2) & history_mask(TAGE_BASE_BITS)] >= 2;
+    l->alt_pred = l->alt >= 0 ? l->entry[l->alt]->ctr >= 4 : base;
+    if (l->provider < 0) {
+        l->provider_pred = l->pred = base;
+        return;
+    }
+
+    tage_entry_t *e = l->entry[l->provider];
+    l->provider_pred = e->ctr >= 4;
+    /* a newly allocated entry is not trusted over the alternate */
+    bool weak = e->ctr == 3 || e->ctr == 4;
+    l->pred = weak && e->useful == 0 ? l->alt_pred : l->provider_pred;
+}
+
+static bool tage_predict(dir_predictor_t *d, uint64_t PC, uint64_t ghr)
+{
+    tage_lookup_t l;
+    tage_lookup((tage_pred_t *)d, PC, ghr, &l);
+    return l.pred;
+}
+
+static void tage_update(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken)
+{
+    tage_pred_t *p = (tage_pred_t *)d;
+    tage_lookup_t l;
+    tage_lookup(p, PC, ghr, &l);
+
+    /* allocate in a longer table when the final prediction was wrong */
+    if (l.pred != taken && l.provider < TAGE_TABLES - 1) {
+        bool allocated = false;
+        for (int t = l.provider + 1; t < TAGE_TABLES && !allocated; t++) {
+            tage_entry_t *e = l.entry[t];
+            if (e->useful == 0) {
+                e->tag = tage_tag(PC, ghr, t);
+                e->valid = true;
+                e->ctr = taken ? 4 : 3;
+                allocated = true;
+            }
+        }
+        for (int t = l.provider + 1; t < TAGE_TABLES && !allocated; t++) {
+            if (l.entry[t]->useful > 0)
+                l.entry[t]->useful--;
+        }
+    }
+
+    if (l.provider >= 0) {
+        tage_entry_t *e = l.entry[l.provider];
+        if (l.provider_pred != l.alt_pred)
+            counter_train(&e->useful, l.provider_pred == taken, 3);
+        counter_train(&e->ctr, taken, 7);
+    }
+    else
+        counter_train(&p->bimodal[(PC >> 2) & history_mask(TAGE_BASE_BITS)], taken, 3);
+
+    if (++p->updates % TAGE_RESET_PERIOD == 0) {
+        for (int t = 0; t < TAGE_TABLES; t++)
+            for (int i = 0; i < (1 << TAGE_TABLE_BITS); i++)
+                p->table[t][i].useful >>= 1;
+    }
+}
+
+static void tage_destroy(dir_predictor_t *d)
+{
+    free(d);
+}
+
+static void tage_checkpoint(dir_predictor_t *d, ckpt_t *ck)
+{
+    tage_pred_t *p = (tage_pred_t *)d;
+    ckpt_var(ck, p->bimodal);
+    ckpt_var(ck, p->table);
+    ckpt_var(ck, p->updates);
+}
+
+static dir_predictor_t *tage_new(int history, int table_bits)
+{
+    tage_pred_t *p = calloc(1, sizeof(tage_pred_t));
+    p->base.name = "tage";
+    p->base.history = TAGE_HISTORY[TAGE_TABLES - 1];
+    p->base.predict = tage_predict;
+    p->base.update = tage_update;
+    p->base.destroy = tage_destroy;
+    p->base.checkpoint = tage_checkpoint;
+    return &p->base;
+}
+
+/***************************************************************/
+/* perceptron: one weight per history bit, trained on a        */
+/* misprediction or a low-confidence output                    */
+/***************************************************************/
+
+typedef struct {
+    dir_predictor_t base;
+    int threshold;
+    int8_t *weights;        /* history + 1 weights per perceptron, bias first */
+} perceptron_pred_t;
+
+static int perceptron_output(perceptron_pred_t *p, uint64_t PC, uint64_t ghr)
+{
+    int n = p->base.history + 1;
+    int8_t *w = &p->weights[((PC >> 2) & history_mask(PERCEPTRON_BITS)) * n];
+    int y = w[0];
+    for (int i = 1; i < n; i++)
+        y += (ghr >> (i - 1)) & 1 ? w[i] : -w[i];
+    return y;
+}
+
+static bool perceptron_predict(dir_predictor_t *d, uint64_t PC, uint64_t ghr)
+{
+    return perceptron_output((perceptron_pred_t *)d, PC, ghr) >= 0;
+}
+
+static void perceptron_update(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken)
+{
+    perceptron_pred_t *p = (perceptron_pred_t *)d;
+    int y = perceptron_output(p, PC, ghr);
+    if ((y >= 0) == taken && abs(y) > p->threshold)
+        return;
+
+    int n = p->base.history + 1;
+    int8_t *w = &p->weights[((PC >> 2) & history_mask(PERCEPTRON_BITS)) * n];
+    for (int i = 0; i < n; i++) {
+        bool agree = i == 0 ? taken : (((ghr >> (i - 1)) & 1) == taken);
+        if (agree && w[i] < 127)
+            w[i]++;
+        else if (!agree && w[i] > -127)
+            w[i]--;
+    }
+}
+
+static void perceptron_destroy(dir_predictor_t *d)
+{
+    free(((perceptron_pred_t *)d)->weights);
+    free(d);
+}
+
+static void perceptron_checkpoint(dir_predictor_t *d, ckpt_t *ck)
+{
+    perceptron_pred_t *p = (perceptron_pred_t *)d;
+    ckpt_blob(ck, p->weights, (1 << PERCEPTRON_BITS) * (p->base.history + 1));
+}
+
+static dir_predictor_t *perceptron_new(int history, int table_bits)
+{
+    perceptron_pred_t *p = calloc(1, sizeof(perceptron_pred_t));
+    p->base.name = "perceptron";
+    p->base.history = history;
+    p->base.predict = perceptron_predict;
+    p->base.update = perceptron_update;
+    p->base.destroy = perceptron_destroy;
+    p->base.checkpoint = perceptron_checkpoint;
+    p->threshold = 1.93 * history + 14;
+    p->weights = calloc((1 << PERCEPTRON_BITS) * (history + 1), sizeof(int8_t));
+    return &p->base;
+}
+
+static const struct {
+    const char *name;
+    dir_predictor_t *(*create)(int history, int table_bits);
+} PREDICTORS[] = {
+    { "bimodal", bimodal_new },
+    { "gshare", gshare_new },
+    { "tournament", tournament_new },
+    { "tage", tage_new },
+    { "perceptron", perceptron_new },
+};
+#define NUM_PREDICTORS (sizeof(PREDICTORS) / sizeof(PREDICTORS[0]))
+
+dir_predictor_t *dir_new(const char *name, int history, int table_bits)
+{
+    if (history < 0 || history > 64 || table_bits < 1 || table_bits > 24) {
+        printf("Error: predictor history must be 0-64 bits and tables 1-24 bits\n");
+        exit(-1);
+    }
+    for (int i = 0; i < NUM_PREDICTORS; i++) {
+        if (strcmp(name, PREDICTORS[i].name) == 0)
+            return PREDICTORS[i].create(history, table_bits);
+    }
+    return NULL;
+}
+
+void dir_list()
+{
+    for (int i = 0; i < NUM_PREDICTORS; i++)
+        printf(" %s", PREDICTORS[i].name);
+    printf("\n");
+}
@@ -0,0 +1,43 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Conditional branch direction predictors. The branch predictor in
+ * bp.c owns the BTB and the global history register and asks one of
+ * these whether a conditional branch is taken.
+ */
+#ifndef _DIRPRED_H_
+#define _DIRPRED_H_
+
+#include <stdint.h>
+#include "stdbool.h"
+#include "ckpt.h"
+
+#define TAGE_TABLES         4
+#define TAGE_TABLE_BITS     10
+#define TAGE_TAG_BITS       9
+#define TAGE_BASE_BITS      12
+#define TAGE_RESET_PERIOD   (1 << 18)   /* updates between useful decays */
+#define PERCEPTRON_BITS     8           /* log2 of the perceptron count */
+
+typedef struct dir_predictor dir_predictor_t;
+
+/* ghr holds the outcomes of the most recent conditional branches,
+ * newest in bit 0. update sees the history as it was at predict time
+ * since the history only advances after update returns. */
+struct dir_predictor {
+    const char *name;
+    int history;                /* history bits the predictor uses */
+    bool (*predict)(dir_predictor_t *d, uint64_t PC, uint64_t ghr);
+    void (*update)(dir_predictor_t *d, uint64_t PC, uint64_t ghr, bool taken);
+    void (*destroy)(dir_predictor_t *d);
+    void (*checkpoint)(dir_predictor_t *d, ckpt_t *ck);
+};
+
+/* NULL if name is not a predictor. table_bits sizes the bimodal and
+ * gshare tables; TAGE and perceptron have fixed geometries. */
+dir_predictor_t *dir_new(const char *name, int history, int table_bits);
+void dir_list();
+
+#endif
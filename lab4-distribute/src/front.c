@@ -0,0 +1,261 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "front.h"
+#include "isa.h"
+#include "shell.h"
+#include "trace.h"
+#include "core.h"
+#include <inttypes.h>
+#include <string.h>
+
+static __thread uint64_t fetch_PC;
+static __thread int fetch_wait;             /* icache miss cycles left */
+static __thread fetch_slot_t queue[FRONT_QUEUE];
+static __thread int queue_head, queue_count;
+static __thread uint64_t squashed;
+static __thread bool stopped;
+
+void front_init()
+{
+    front_restart();
+    squashed = 0;
+}
+
+void front_restart()
+{
+    fetch_PC = pipe.PC;
+    fetch_wait = 0;
+    queue_head = queue_count = 0;
+    stopped = false;
+}
+
+void front_stop()
+{
+    stopped = true;
+    if (fetch_wait) {
+        fetch_wait = 0;
+        pipe.icache->waiting = false;
+    }
+}
+
+bool front_idle()
+{
+    return queue_count == 0 && fetch_wait == 0;
+}
+
+int front_count()
+{
+    return queue_count;
+}
+
+fetch_slot_t *front_peek()
+{
+    return queue_count ? &queue[queue_head] : NULL;
+}
+
+void front_pop()
+{
+    queue_head = (queue_head + 1) % FRONT_QUEUE;
+    queue_count--;
+}
+
+uint64_t front_squashed()
+{
+    return squashed;
+}
+
+void front_redirect(uint64_t target)
+{
+    squashed += queue_count;
+    queue_head = queue_count = 0;
+    fetch_PC = target;
+    pipe.PC = target;
+    pipe.bp->flush_cycles++;
+
+    /* drop a miss on the wrong path; the right path refetches */
+    if (fetch_wait) {
+        fetch_wait = 0;
+        pipe.icache->waiting = false;
+    }
+}
+
+void front_checkpoint(ckpt_t *ck)
+{
+    ckpt_section(ck, "front");
+    ckpt_var(ck, fetch_PC);
+    ckpt_var(ck, fetch_wait);
+    ckpt_var(ck, queue);
+    ckpt_var(ck, queue_head);
+    ckpt_var(ck, queue_count);
+    ckpt_var(ck, squashed);
+    ckpt_var(ck, stopped);
+}
+
+void front_core_vars()
+{
+    CORE_VAR(fetch_PC);
+    CORE_VAR(fetch_wait);
+    CORE_VAR(queue);
+    CORE_VAR(queue_head);
+    CORE_VAR(queue_count);
+    CORE_VAR(squashed);
+    CORE_VAR(stopped);
+}
+
+void front_halt(fetch_slot_t *s)
+{
+    squashed += queue_count;
+    queue_head = queue_count = 0;
+    pipe.PC = s->PC + 4;
+}
+
+/* stops after a predicted-taken branch or at the end of the block */
+static void front_fill(int width)
+{
+    if (fetch_wait) {
+        if (--fetch_wait > 0)
+            return;
+        pipe.icache->waiting = false;
+        cache_complete(pipe.icache, fetch_PC);
+    }
+    else if (queue_count + width <= FRONT_QUEUE) {
+        int wait = cache_update(pipe.icache, fetch_PC, fetch_PC);
+        if (wait) {
+            TRACE(1, TRACE_CACHE, "icache     | %" PRIX64 " waits %d\n", fetch_PC, wait);
+            fetch_wait = wait;
+            pipe.icache->waiting = true;
+            return;
+        }
+    }
+    else
+        return;
+
+    for (int i = 0; i < width && queue_count < FRONT_QUEUE; i++) {
+        fetch_slot_t *s = &queue[(queue_head + queue_count) % FRONT_QUEUE];
+        slot_decode(s, fetch_PC);
+        s->predicted = fetch_PC;
+        bp_predict(pipe.bp, &s->predicted);
+        queue_count++;
+        stat_inst_fetch++;
+
+        uint64_t next = s->predicted;
+        fetch_PC = next;
+        if (next != s->PC + 4 || !same_block(pipe.icache, s->PC, next))
+            break;
+    }
+}
+
+void front_fetch(int width)
+{
+    if (HLT || stopped)
+        return;
+    front_fill(width);
+    pipe.PC = fetch_PC;
+}
+
+void slot_decode(fetch_slot_t *s, uint64_t PC)
+{
+    Pipe_Op *cached = predecode_lookup(PC);
+    memset(s, 0, sizeof(*s));
+    if (cached)
+        s->operation = *cached;
+    else {
+        s->operation = initialize_operation();
+        s->operation.word = mem_read_32(PC);
+        s->operation.PC = PC;
+        isa_decode(s->operation.word, &s->operation);
+        predecode_fill(PC, &s->operation);
+    }
+    s->PC = PC;
+}
+
+uint64_t slot_execute(fetch_slot_t *s)
+{
+    Pipe_Op *op = &s->operation;
+    const isa_entry_t *entry = isa_lookup(op->word);
+    isa_state_t state = {
+        .regs = pipe.REGS,
+        .FLAG_N = pipe.FLAG_N,
+        .FLAG_Z = pipe.FLAG_Z,
+        .PC = s->PC,
+    };
+
+    if (entry->execute)
+        entry->execute(op, &state);
+    if (op->type == DTYPE) {
+        s->address = pipe.REGS[op->Rn] + (int64_t)op->address;
+        if (entry->memory)
+            entry->memory(op, pipe.REGS);
+    }
+    pipe.REGS[31] = 0;
+    pipe.FLAG_N = state.FLAG_N;
+    pipe.FLAG_Z = state.FLAG_Z;
+    return op->will_jump ? state.PC : s->PC + 4;
+}
+
+bp_kind_t slot_kind(const fetch_slot_t *s)
+{
+    const Pipe_Op *op = &s->operation;
+    if (!(isa_lookup(op->word)->flags & ISA_BRANCH))
+        return BP_NONE;
+    return op->type == CTYPE ? BP_COND :
+           op->type == BTYPE ? BP_JUMP : BP_INDIRECT;
+}
+
+bool slot_resolve(fetch_slot_t *s, uint64_t next)
+{
+    Pipe_Op *op = &s->operation;
+    bool mispredicted = next != s->predicted;
+    bp_kind_t kind = slot_kind(s);
+
+    if (kind != BP_NONE) {
+        bp_update(pipe.bp, s->PC, next, op->will_jump, kind);
+        pipe.bp->branches++;
+        pipe.bp->cond_branches += kind == BP_COND;
+        pipe.bp->indirect_branches += kind == BP_INDIRECT;
+        if (mispredicted) {
+            TRACE(1, TRACE_BP, "BP         | %" PRIX64 " mispredicted, to %" PRIX64 "\n",
+                  s->PC, next);
+            pipe.bp->mispredicts++;
+            pipe.bp->cond_mispredicts += kind == BP_COND;
+            pipe.bp->indirect_mispredicts += kind == BP_INDIRECT;
+        }
+    }
+    return mispredicted;
+}
+
+int slot_sources(const fetch_slot_t *s, uint8_t *regs)
+{
+    const Pipe_Op *op = &s->operation;
+    int count = 0;
+
+    switch (op->type) {
+        case RTYPE:
+            regs[count++] = op->Rn;
+            regs[count++] = op->Rm;
+            break;
+        case ITYPE:
+            regs[count++] = op->Rn;
+            break;
+        case DTYPE:
+            regs[count++] = op->Rn;
+            if (op->is_store)
+                regs[count++] = op->Rt;
+            break;
+        case CTYPE:
+            regs[count++] = op->opcode == OPCODE_BCOND ? FLAGS_REG : op->Rt;
+            break;
+    }
+
+    /* XZR is never written */
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (regs[i] != 31)
+            regs[kept++] = regs[i];
+    }
+    return kept;
+}
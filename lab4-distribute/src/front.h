@@ -0,0 +1,62 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Front end shared by the wide and out-of-order models. It fetches
+ * along the predicted path into a fetch queue; the back end takes
+ * instructions from the head, executes them against the architectural
+ * state in program order and redirects fetch when a prediction was
+ * wrong.
+ */
+#ifndef _FRONT_H_
+#define _FRONT_H_
+
+#include "pipe.h"
+
+#define FRONT_MAX_WIDTH     8
+#define FRONT_QUEUE         (2 * FRONT_MAX_WIDTH)
+#define FLAGS_REG           ARM_REGS    /* N and Z, as one more register */
+#define OPCODE_BCOND        0x2A0
+#define OPCODE_HLT          0x6A2
+
+typedef struct {
+    Pipe_Op operation;
+    uint64_t PC;
+    uint64_t predicted;     /* next PC the front end went to */
+    uint64_t address;       /* memory operations, set by slot_execute */
+} fetch_slot_t;
+
+void front_init();
+/* empty the queue and fetch from pipe.PC, keeping the statistics */
+void front_restart();
+/* fetch nothing more until front_restart */
+void front_stop();
+bool front_idle();
+/* up to width instructions from one icache block */
+void front_fetch(int width);
+int front_count();
+fetch_slot_t *front_peek();
+void front_pop();
+/* squash the queue and fetch from target */
+void front_redirect(uint64_t target);
+/* s was a halt: nothing after it is fetched */
+void front_halt(fetch_slot_t *s);
+uint64_t front_squashed();
+void front_checkpoint(ckpt_t *ck);
+void front_core_vars();
+
+/* Decode the instruction at PC into s, through the predecode cache. */
+void slot_decode(fetch_slot_t *s, uint64_t PC);
+/* Execute s against pipe.REGS and the flags; returns the real next
+ * PC. */
+uint64_t slot_execute(fetch_slot_t *s);
+/* BP_NONE if s is not a branch */
+bp_kind_t slot_kind(const fetch_slot_t *s);
+/* Train the predictor on s, which went to next; true if it was
+ * mispredicted. */
+bool slot_resolve(fetch_slot_t *s, uint64_t next);
+/* Registers s reads, FLAGS_REG for the flags; returns how many. */
+int slot_sources(const fetch_slot_t *s, uint8_t *regs);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "func.h"
+#include "front.h"
+#include "shell.h"
+
+/* contents only; whatever the access would have waited is skipped */
+static void func_touch(cache_t *c, uint64_t addr, uint64_t pc, bool write)
+{
+    int wait = write ? cache_write(c, addr, pc) : cache_update(c, addr, pc);
+    if (wait)
+        cache_complete(c, addr);
+}
+
+uint64_t func_run(uint64_t count, bool warm)
+{
+    fetch_slot_t s;
+    uint64_t n = 0;
+    bool fetched = false;
+    uint64_t last_PC = 0;
+
+    while (n < count && !HLT) {
+        slot_decode(&s, pipe.PC);
+        if (warm && (!fetched || !same_block(pipe.icache, last_PC, s.PC)))
+            func_touch(pipe.icache, s.PC, s.PC, false);
+        fetched = true;
+        last_PC = s.PC;
+
+        uint64_t next = slot_execute(&s);
+        n++;
+        if (warm) {
+            Pipe_Op *op = &s.operation;
+            if (op->type == DTYPE)
+                func_touch(pipe.dcache, s.address, s.PC, op->is_store);
+            bp_kind_t kind = slot_kind(&s);
+            if (kind != BP_NONE)
+                bp_update(pipe.bp, s.PC, next, op->will_jump, kind);
+        }
+        pipe.PC = HLT ? s.PC + 4 : next;
+    }
+    stat_inst_retire += n;
+    return n;
+}
@@ -0,0 +1,22 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Functional simulation: instructions run straight against the
+ * architectural state with the same handlers the pipelines use, and
+ * no timing at all. Used to skip to a region of interest.
+ */
+#ifndef _FUNC_H_
+#define _FUNC_H_
+
+#include <stdint.h>
+#include "stdbool.h"
+
+/* Run up to count instructions from pipe.PC, stopping after a HLT.
+ * With warm set the caches see every fetch and data access and the
+ * predictor trains on every branch. Returns the instructions run.
+ * The timing model must be drained first and restarted afterwards. */
+uint64_t func_run(uint64_t count, bool warm);
+
+#endif
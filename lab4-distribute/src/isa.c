@@ -0,0 +1,326 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "isa.h"
+#include "shell.h"
+#include "mem.h"
+
+/* opcode bits per format, in the order formats used to be probed */
+#define ISA_BITS_BTYPE  6
+#define ISA_BITS_CTYPE  8
+#define ISA_BITS_ITYPE  10
+#define ISA_BITS_RTYPE  11
+#define ISA_BITS_DTYPE  11
+#define ISA_BITS_IWTYPE 11
+
+/***************************************************************/
+/* Decode helpers, one per format.                             */
+/***************************************************************/
+
+static void decode_R(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = RTYPE;
+    op->Rm = (word >> 16) & 0x1F;
+    op->misc = (word >> 10) & 0x3F;
+    op->Rn = (word >> 5) & 0x1F;
+    op->Rt = word & 0x1F;
+}
+
+static void decode_D(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = DTYPE;
+    op->address = ((word >> 12) & 0x1FF);
+    op->misc = (word >> 10) & 0x3;
+    op->Rn = (word >> 5) & 0x1F;
+    op->Rt = word & 0x1F;
+}
+
+static void decode_B(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = BTYPE;
+    int32_t imm26 = word & 0x03FFFFFF;
+    if (imm26 & (1 << 25)) {
+        imm26 |= 0xFC000000;
+    }
+    imm26 <<= 2;
+    op->address = imm26;
+}
+
+static void decode_CB(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = CTYPE;
+    int32_t imm19 = (word >> 5) & 0x7FFFF;
+    if (imm19 & (1 << 18)) {
+        imm19 |= 0xFFF80000;  // Set bits 31:19 to extend the sign
+    }
+    imm19 <<= 2;
+    op->address = imm19;
+    op->Rt = word & 0x1F;
+}
+
+static void decode_IW(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = IWTYPE;
+    op->immediate = (word >> 5) & 0xFFFF;
+    op->Rt = word & 0x1F;
+}
+
+static void decode_I(Pipe_Op *op, uint32_t word, uint16_t opcode)
+{
+    op->opcode = opcode;
+    op->type = ITYPE;
+    op->immediate = (word >> 10) & 0xFFF;
+    op->Rn = (word >> 5) & 0x1F;
+    op->Rt = word & 0x1F;
+}
+
+#define ISA_DECODE_BTYPE  decode_B
+#define ISA_DECODE_CTYPE  decode_CB
+#define ISA_DECODE_ITYPE  decode_I
+#define ISA_DECODE_RTYPE  decode_R
+#define ISA_DECODE_DTYPE  decode_D
+#define ISA_DECODE_IWTYPE decode_IW
+
+/***************************************************************/
+/* Execute handlers.                                           */
+/***************************************************************/
+
+static void take_branch(Pipe_Op *op, isa_state_t *s)
+{
+    s->PC = s->PC + (int64_t) op->address;
+    op->will_jump = true;
+}
+
+static void set_flags(Pipe_Op *op, isa_state_t *s)
+{
+    s->FLAG_Z = (s->regs[op->Rt] == 0);
+    s->FLAG_N = (s->regs[op->Rt] < 0);
+    op->flagSet = true;
+}
+
+static void execute_b(Pipe_Op *op, isa_state_t *s)
+{
+    take_branch(op, s);
+}
+
+static void execute_cbnz(Pipe_Op *op, isa_state_t *s)
+{
+    if (s->regs[op->Rt] != 0)
+        take_branch(op, s);
+}
+
+static void execute_cbz(Pipe_Op *op, isa_state_t *s)
+{
+    if (s->regs[op->Rt] == 0)
+        take_branch(op, s);
+}
+
+static void execute_bcond(Pipe_Op *op, isa_state_t *s)
+{
+    bool taken;
+    switch (op->Rt) {
+        case 0:  taken = s->FLAG_Z; break;                  // BEQ
+        case 1:  taken = !s->FLAG_Z; break;                 // BNE
+        case 12: taken = !s->FLAG_Z && !s->FLAG_N; break;  // BGT
+        case 11: taken = s->FLAG_N; break;                  // BLT
+        case 10: taken = s->FLAG_Z || !s->FLAG_N; break;    // BGE
+        case 13: taken = s->FLAG_Z || s->FLAG_N; break;     // BLE
+        default: taken = false;
+    }
+    if (taken)
+        take_branch(op, s);
+}
+
+static void execute_addi(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] + op->immediate;
+    op->mod_reg = true;
+}
+
+static void execute_addis(Pipe_Op *op, isa_state_t *s)
+{
+    execute_addi(op, s);
+    set_flags(op, s);
+}
+
+static void execute_subi(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] - op->immediate;
+    op->mod_reg = true;
+}
+
+static void execute_subis(Pipe_Op *op, isa_state_t *s)
+{
+    execute_subi(op, s);
+    set_flags(op, s);
+}
+
+static void execute_lsl(Pipe_Op *op, isa_state_t *s)
+{
+    uint8_t shamt = op->immediate & 0x3F;
+    int8_t shift = (op->immediate >> 6) & 0xFF;
+    op->mod_reg = true;
+    if (shamt == 0x3F) { // LSR
+        s->regs[op->Rt] = s->regs[op->Rn] >> shift;
+    } else { // LSL
+        shift = ((-shift) % 64 + 64) % 64;
+        s->regs[op->Rt] = s->regs[op->Rn] << shift;
+    }
+}
+
+static void execute_add(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] + s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_adds(Pipe_Op *op, isa_state_t *s)
+{
+    execute_add(op, s);
+    set_flags(op, s);
+}
+
+static void execute_and(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] & s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_ands(Pipe_Op *op, isa_state_t *s)
+{
+    execute_and(op, s);
+    set_flags(op, s);
+}
+
+static void execute_eor(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] ^ s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_orr(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] | s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_sub(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] - s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_subs(Pipe_Op *op, isa_state_t *s)
+{
+    execute_sub(op, s);
+    set_flags(op, s);
+}
+
+static void execute_mul(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = s->regs[op->Rn] * s->regs[op->Rm];
+    op->mod_reg = true;
+}
+
+static void execute_br(Pipe_Op *op, isa_state_t *s)
+{
+    s->PC = (uint64_t) s->regs[op->Rn];
+    op->will_jump = true;
+}
+
+static void execute_movz(Pipe_Op *op, isa_state_t *s)
+{
+    s->regs[op->Rt] = op->immediate;
+    op->mod_reg = true;
+}
+
+static void execute_hlt(Pipe_Op *op, isa_state_t *s)
+{
+    HLT = TRUE;
+}
+
+/***************************************************************/
+/* Memory handlers, run in the MEM stage.                      */
+/***************************************************************/
+
+static inline uint64_t mem_address(Pipe_Op *op, int64_t *regs)
+{
+    return regs[op->Rn] + (int64_t) op->address;
+}
+
+static void memory_ldur(Pipe_Op *op, int64_t *regs)
+{
+    regs[op->Rt] = mem_read_64(mem_address(op, regs));
+    op->mod_reg = true;
+}
+
+static void memory_ldurw(Pipe_Op *op, int64_t *regs)
+{
+    regs[op->Rt] = mem_read_32(mem_address(op, regs));
+    op->mod_reg = true;
+}
+
+static void memory_ldurb(Pipe_Op *op, int64_t *regs)
+{
+    regs[op->Rt] = mem_read_8(mem_address(op, regs));
+    op->mod_reg = true;
+}
+
+static void memory_ldurh(Pipe_Op *op, int64_t *regs)
+{
+    regs[op->Rt] = mem_read_16(mem_address(op, regs));
+    op->mod_reg = true;
+}
+
+static void memory_stur(Pipe_Op *op, int64_t *regs)
+{
+    mem_write_64(mem_address(op, regs), regs[op->Rt]);
+}
+
+static void memory_sturw(Pipe_Op *op, int64_t *regs)
+{
+    mem_write_32(mem_address(op, regs), regs[op->Rt]);
+}
+
+static void memory_sturb(Pipe_Op *op, int64_t *regs)
+{
+    mem_write_8(mem_address(op, regs), regs[op->Rt]);
+}
+
+static void memory_sturh(Pipe_Op *op, int64_t *regs)
+{
+    mem_write_16(mem_address(op, regs), regs[op->Rt]);
+}
+
+/***************************************************************/
+/* Dispatch table.                                             */
+/***************************************************************/
+
+const isa_entry_t ISA_TABLE[ISA_TABLE_SIZE] = {
+#define ISA_OP(name, format, first, last, flags, execute, memory) \
+    [first ... last] = { format, ISA_BITS_##format, flags, \
+                         ISA_DECODE_##format, execute, memory, #name },
+#include "isa.def"
+#undef ISA_OP
+};
+
+bool isa_decode(uint32_t word, Pipe_Op *op)
+{
+    const isa_entry_t *entry = isa_lookup(word);
+    if (!entry->decode)
+        return false;
+
+    uint16_t opcode = (word >> (32 - entry->op_len)) << (11 - entry->op_len);
+    op->is_load = (entry->flags & ISA_LOAD) != 0;
+    op->is_store = (entry->flags & ISA_STORE) != 0;
+    entry->decode(op, word, opcode);
+    return true;
+}
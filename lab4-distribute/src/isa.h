@@ -0,0 +1,53 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Opcode dispatch table, built at compile time from isa.def.
+ */
+#ifndef _ISA_H_
+#define _ISA_H_
+
+#include <stddef.h>
+#include "pipe.h"
+
+#define ISA_TABLE_SIZE 2048
+
+/* flags column of isa.def */
+#define ISA_LOAD  0x1
+#define ISA_STORE 0x2
+#define ISA_BRANCH 0x4
+
+/* architectural state an instruction executes against */
+typedef struct {
+    int64_t *regs;
+    int FLAG_N;
+    int FLAG_Z;
+    uint64_t PC;    /* PC of the instruction, redirected by taken branches */
+} isa_state_t;
+
+typedef void (*isa_decode_fn)(Pipe_Op *op, uint32_t word, uint16_t opcode);
+typedef void (*isa_execute_fn)(Pipe_Op *op, isa_state_t *s);
+typedef void (*isa_memory_fn)(Pipe_Op *op, int64_t *regs);
+
+typedef struct {
+    uint8_t type;           /* instruction format, 0 if undefined */
+    uint8_t op_len;         /* opcode bits used by the format */
+    uint8_t flags;
+    isa_decode_fn decode;
+    isa_execute_fn execute; /* EX stage, NULL for memory instructions */
+    isa_memory_fn memory;   /* MEM stage, NULL for everything else */
+    const char *name;
+} isa_entry_t;
+
+/* indexed by the top 11 bits of the instruction word */
+extern const isa_entry_t ISA_TABLE[ISA_TABLE_SIZE];
+
+static inline const isa_entry_t *isa_lookup(uint32_t word)
+{
+    return &ISA_TABLE[word >> 21];
+}
+
+bool isa_decode(uint32_t word, Pipe_Op *op);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "mem.h"
+#include "pipe.h"
+#include "config.h"
+#include "core.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "guest memory accessors assume a little-endian host"
+#endif
+
+/* memory will be dynamically allocated at initialization */
+mem_region_t MEM_REGIONS[] = {
+    { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
+    { MEM_DATA_START, MEM_DATA_SIZE, NULL },
+    { MEM_STACK_START, MEM_STACK_SIZE, NULL },
+};
+const int MEM_NREGIONS = sizeof(MEM_REGIONS) / sizeof(mem_region_t);
+
+typedef struct {
+    uint64_t vpn;
+    uint8_t *page;
+} mem_tlb_entry_t;
+
+/* page table: L1 entries point at tables of host page pointers. The
+ * cores of a parallel run fill it in concurrently, and each host
+ * thread has its own TLB. */
+static uint8_t **mem_l1[1 << MEM_L1_BITS];
+static __thread mem_tlb_entry_t mem_tlb[MEM_TLB_SIZE];
+
+/* stores held back from the other threads, see mem_buffer_use */
+struct mem_buffer {
+    struct mem_buffered_word {
+        uint64_t word;          /* address / 8 + 1, 0 for a free slot */
+        uint64_t data;
+        uint8_t mask;           /* bytes of data written */
+    } *slots;
+    uint32_t size, count;
+};
+static __thread mem_buffer_t *buffered;
+
+static void mem_map_page(uint64_t vpn, uint8_t *page)
+{
+    uint8_t ***l2 = &mem_l1[vpn >> MEM_L2_BITS];
+    uint8_t **table = __atomic_load_n(l2, __ATOMIC_ACQUIRE);
+    if (table == NULL) {
+        uint8_t **fresh = calloc(1 << MEM_L2_BITS, sizeof(uint8_t *));
+        if (__atomic_compare_exchange_n(l2, &table, fresh, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            table = fresh;
+        else
+            free(fresh);
+    }
+    __atomic_store_n(&table[vpn & ((1 << MEM_L2_BITS) - 1)], page, __ATOMIC_RELEASE);
+}
+
+void mem_tlb_flush()
+{
+    for (int i = 0; i < MEM_TLB_SIZE; i++) {
+        mem_tlb[i].vpn = UINT64_MAX;
+        mem_tlb[i].page = NULL;
+    }
+}
+
+static void *mem_alloc(uint64_t size)
+{
+    if (!config.mem_sparse)
+        return calloc(size, 1);
+
+    /* demand-zero: nothing is resident until the guest touches it */
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_init                                         */
+/*                                                             */
+/* Purpose: Size and allocate every region. Pages are entered  */
+/*          into the page table on first touch, so startup     */
+/*          cost does not grow with the region sizes.          */
+/*                                                             */
+/***************************************************************/
+void mem_init()
+{
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *r = &MEM_REGIONS[i];
+        if (r->start == MEM_DATA_START)
+            r->size = config.mem_data_size;
+        else if (r->start == MEM_STACK_START)
+            r->size = config.mem_stack_size;
+    }
+
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *r = &MEM_REGIONS[i];
+        for (int j = 0; j < i; j++) {
+            mem_region_t *o = &MEM_REGIONS[j];
+            if (r->start < o->start + o->size && o->start < r->start + r->size) {
+                printf("Error: memory regions at 0x%" PRIx64 " and 0x%" PRIx64
+                       " overlap\n", o->start, r->start);
+                exit(-1);
+            }
+        }
+        if ((r->start + r->size) >> (MEM_PAGE_BITS + MEM_L2_BITS + MEM_L1_BITS)) {
+            printf("Error: memory region at 0x%" PRIx64 " is too large\n", r->start);
+            exit(-1);
+        }
+
+        r->mem = mem_alloc(r->size);
+        if (r->mem == NULL) {
+            printf("Error: Can't allocate %" PRIu64 " bytes of memory\n", r->size);
+            exit(-1);
+        }
+    }
+    mem_tlb_flush();
+}
+
+/* enter a page into the page table if a region covers all of it */
+static uint8_t *mem_map_region_page(uint64_t vpn)
+{
+    uint64_t base = vpn << MEM_PAGE_BITS;
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *r = &MEM_REGIONS[i];
+        if (base >= r->start && base + MEM_PAGE_SIZE <= r->start + r->size) {
+            uint8_t *page = r->mem + (base - r->start);
+            mem_map_page(vpn, page);
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static int mem_tlb_fill(uint64_t vpn, mem_tlb_entry_t *e)
+{
+    if (vpn >> (MEM_L1_BITS + MEM_L2_BITS))
+        return 0;
+    uint8_t **l2 = __atomic_load_n(&mem_l1[vpn >> MEM_L2_BITS], __ATOMIC_ACQUIRE);
+    uint8_t *page = l2 ? __atomic_load_n(&l2[vpn & ((1 << MEM_L2_BITS) - 1)],
+                                         __ATOMIC_ACQUIRE) : NULL;
+    if (page == NULL)
+        page = mem_map_region_page(vpn);
+    if (page == NULL)
+        return 0;
+    e->vpn = vpn;
+    e->page = page;
+    return 1;
+}
+
+/* host pointer for an access that stays within one mapped page */
+static inline uint8_t *mem_host(uint64_t address, int bytes)
+{
+    if ((address & MEM_PAGE_MASK) + bytes > MEM_PAGE_SIZE)
+        return NULL;
+    uint64_t vpn = address >> MEM_PAGE_BITS;
+    mem_tlb_entry_t *e = &mem_tlb[vpn & (MEM_TLB_SIZE - 1)];
+    if (e->vpn != vpn && !mem_tlb_fill(vpn, e))
+        return NULL;
+    return e->page + (address & MEM_PAGE_MASK);
+}
+
+static uint8_t *mem_byte(uint64_t address)
+{
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        if (address >= MEM_REGIONS[i].start &&
+                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size))
+            return &MEM_REGIONS[i].mem[address - MEM_REGIONS[i].start];
+    }
+    return NULL;
+}
+
+/* byte at a time, for unmapped, partial-page and page-crossing accesses */
+static uint64_t mem_read_slow(uint64_t address, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        uint8_t *p = mem_byte(address + i);
+        value = (value << 8) | (p ? *p : 0);
+    }
+    return value;
+}
+
+static void mem_write_slow(uint64_t address, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        /* through the page table where it can, so the page counts as
+         * touched */
+        uint8_t *p = mem_host(address + i, 1);
+        if (p == NULL)
+            p = mem_byte(address + i);
+        if (p)
+            *p = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static inline void mem_text_written(uint64_t address, int bytes)
+{
+    if (address + bytes > MEM_TEXT_START &&
+            address < MEM_TEXT_START + MEM_TEXT_SIZE) {
+        for (int i = 0; i < bytes; i += 4) {
+            predecode_invalidate(address + i);
+            /* the other threads' tables hear of it at the barrier */
+            if (core_threaded)
+                parallel_text_written(address + i);
+        }
+    }
+}
+
+/* zero every region and forget what was touched */
+static void mem_clear()
+{
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *r = &MEM_REGIONS[i];
+        if (config.mem_sparse)
+            munmap(r->mem, r->size);
+        else
+            free(r->mem);
+        r->mem = mem_alloc(r->size);
+        if (r->mem == NULL) {
+            printf("Error: Can't allocate %" PRIu64 " bytes of memory\n", r->size);
+            exit(-1);
+        }
+    }
+    for (int i = 0; i < (1 << MEM_L1_BITS); i++) {
+        free(mem_l1[i]);
+        mem_l1[i] = NULL;
+    }
+    mem_tlb_flush();
+}
+
+typedef struct {
+    uint32_t region;
+    uint32_t reserved;
+    uint64_t vpn;
+} mem_ckpt_page_t;
+
+static int mem_page_touched(const mem_region_t *r, uint64_t vpn)
+{
+    uint64_t base = vpn << MEM_PAGE_BITS;
+    if (base < r->start || base + MEM_PAGE_SIZE > r->start + r->size)
+        return 1;   /* partial pages are never in the page table */
+    uint8_t **l2 = mem_l1[vpn >> MEM_L2_BITS];
+    return l2 && l2[vpn & ((1 << MEM_L2_BITS) - 1)];
+}
+
+/* copy the part of page vpn that r covers between the region and buf */
+static void mem_page_copy(mem_region_t *r, uint64_t vpn, uint8_t *buf, int to_region)
+{
+    uint64_t base = vpn << MEM_PAGE_BITS;
+    uint64_t lo = base > r->start ? base : r->start;
+    uint64_t hi = base + MEM_PAGE_SIZE < r->start + r->size ?
+                  base + MEM_PAGE_SIZE : r->start + r->size;
+    if (to_region)
+        memcpy(r->mem + (lo - r->start), buf + (lo - base), hi - lo);
+    else
+        memcpy(buf + (lo - base), r->mem + (lo - r->start), hi - lo);
+}
+
+static uint64_t mem_first_vpn(const mem_region_t *r)
+{
+    return r->start >> MEM_PAGE_BITS;
+}
+
+static uint64_t mem_last_vpn(const mem_region_t *r)
+{
+    return (r->start + r->size - 1) >> MEM_PAGE_BITS;
+}
+
+void mem_checkpoint(ckpt_t *ck)
+{
+    uint64_t count = 0, limit = 0;
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *r = &MEM_REGIONS[i];
+        limit += mem_last_vpn(r) - mem_first_vpn(r) + 1;
+        if (!ckpt_saving(ck))
+            continue;
+        for (uint64_t vpn = mem_first_vpn(r); vpn <= mem_last_vpn(r); vpn++)
+            count += mem_page_touched(r, vpn);
+    }
+
+    ckpt_section(ck, "memory");
+    ckpt_meta(ck, &count, sizeof(count));
+    if (count > limit) {
+        ckpt_error(ck, "more pages than the regions hold");
+        return;
+    }
+    mem_ckpt_page_t *pages = calloc(count ? count : 1, sizeof(mem_ckpt_page_t));
+    if (ckpt_saving(ck)) {
+        uint64_t n = 0;
+        for (int i = 0; i < MEM_NREGIONS; i++) {
+            mem_region_t *r = &MEM_REGIONS[i];
+            for (uint64_t vpn = mem_first_vpn(r); vpn <= mem_last_vpn(r); vpn++) {
+                if (mem_page_touched(r, vpn))
+                    pages[n++] = (mem_ckpt_page_t){ i, 0, vpn };
+            }
+        }
+    }
+    ckpt_meta(ck, pages, count * sizeof(mem_ckpt_page_t));
+    for (uint64_t n = 0; n < count; n++) {
+        if (pages[n].region >= MEM_NREGIONS ||
+            pages[n].vpn < mem_first_vpn(&MEM_REGIONS[pages[n].region]) ||
+            pages[n].vpn > mem_last_vpn(&MEM_REGIONS[pages[n].region]))
+            ckpt_error(ck, "page outside guest memory");
+    }
+    if (ckpt_failed(ck)) {
+        free(pages);
+        return;
+    }
+
+    if (ckpt_loading(ck))
+        mem_clear();
+    ckpt_align(ck, MEM_PAGE_SIZE);
+    static uint8_t buf[MEM_PAGE_SIZE];
+    for (uint64_t n = 0; n < count; n++) {
+        mem_region_t *r = &MEM_REGIONS[pages[n].region];
+        if (ckpt_saving(ck)) {
+            memset(buf, 0, sizeof(buf));
+            mem_page_copy(r, pages[n].vpn, buf, 0);
+        }
+        ckpt_raw(ck, buf, sizeof(buf));
+        if (ckpt_loading(ck)) {
+            mem_page_copy(r, pages[n].vpn, buf, 1);
+            mem_map_region_page(pages[n].vpn);
+        }
+    }
+    free(pages);
+}
+
+mem_buffer_t *mem_buffer_new()
+{
+    mem_buffer_t *b = calloc(1, sizeof(mem_buffer_t));
+    b->size = 256;
+    b->slots = calloc(b->size, sizeof(b->slots[0]));
+    return b;
+}
+
+void mem_buffer_free(mem_buffer_t *b)
+{
+    free(b->slots);
+    free(b);
+}
+
+void mem_buffer_use(mem_buffer_t *b)
+{
+    buffered = b;
+}
+
+/* slot for the 8-byte word at address, added if create */
+static struct mem_buffered_word *mem_buffer_slot(mem_buffer_t *b, uint64_t address,
+                                                 bool create)
+{
+    uint64_t word = (address >> 3) + 1;
+    uint32_t i = (word * 0x9E3779B97F4A7C15ULL) >> 32 & (b->size - 1);
+    while (b->slots[i].word && b->slots[i].word != word)
+        i = (i + 1) & (b->size - 1);
+    if (b->slots[i].word || !create)
+        return b->slots[i].word ? &b->slots[i] : NULL;
+
+    if (2 * (b->count + 1) > b->size) {
+        mem_buffer_t grown = { calloc(2 * b->size, sizeof(b->slots[0])), 2 * b->size, 0 };
+        for (uint32_t j = 0; j < b->size; j++) {
+            if (b->slots[j].word)
+                *mem_buffer_slot(&grown, (b->slots[j].word - 1) << 3, true) = b->slots[j];
+        }
+        free(b->slots);
+        *b = grown;
+        return mem_buffer_slot(b, address, true);
+    }
+    b->count++;
+    b->slots[i].word = word;
+    return &b->slots[i];
+}
+
+static void mem_buffer_write(uint64_t address, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        struct mem_buffered_word *w = mem_buffer_slot(buffered, address + i, true);
+        int lane = (address + i) & 7;
+        w->data = (w->data & ~(0xFFULL << 8 * lane)) | ((value >> 8 * i) & 0xFF) << 8 * lane;
+        w->mask |= 1 << lane;
+    }
+}
+
+/* value as read from memory, with this thread's held stores over it */
+static uint64_t mem_buffer_read(uint64_t address, uint64_t value, int bytes)
+{
+    if (buffered->count == 0)
+        return value;
+    for (int i = 0; i < bytes; i++) {
+        struct mem_buffered_word *w = mem_buffer_slot(buffered, address + i, false);
+        int lane = (address + i) & 7;
+        if (w && w->mask & (1 << lane)) {
+            value &= ~(0xFFULL << 8 * i);
+            value |= (w->data >> 8 * lane & 0xFF) << 8 * i;
+        }
+    }
+    return value;
+}
+
+void mem_buffer_drain(mem_buffer_t *b)
+{
+    for (uint32_t i = 0; i < b->size; i++) {
+        struct mem_buffered_word *w = &b->slots[i];
+        for (int lane = 0; w->word && lane < 8; lane++) {
+            if (w->mask & (1 << lane))
+                mem_write_8(((w->word - 1) << 3) + lane, w->data >> 8 * lane);
+        }
+        w->word = 0;
+        w->mask = 0;
+        w->data = 0;
+    }
+    b->count = 0;
+}
+
+#define MEM_ACCESSORS(bits)                                             \
+uint##bits##_t mem_read_##bits(uint64_t address)                        \
+{                                                                       \
+    uint##bits##_t value;                                               \
+    uint8_t *host = mem_host(address, bits / 8);                        \
+    if (host == NULL)                                                   \
+        value = mem_read_slow(address, bits / 8);                       \
+    else                                                                \
+        memcpy(&value, host, sizeof(value));                            \
+    if (buffered)                                                       \
+        value = mem_buffer_read(address, value, bits / 8);              \
+    return value;                                                       \
+}                                                                       \
+                                                                        \
+void mem_write_##bits(uint64_t address, uint##bits##_t value)           \
+{                                                                       \
+    uint8_t *host = mem_host(address, bits / 8);                        \
+    if (buffered)                                                       \
+        mem_buffer_write(address, value, bits / 8);                     \
+    else if (host == NULL)                                              \
+        mem_write_slow(address, value, bits / 8);                       \
+    else                                                                \
+        memcpy(host, &value, sizeof(value));                            \
+    mem_text_written(address, bits / 8);                                \
+}
+
+MEM_ACCESSORS(8)
+MEM_ACCESSORS(16)
+MEM_ACCESSORS(32)
+MEM_ACCESSORS(64)
@@ -0,0 +1,55 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Guest memory. MEM_REGIONS are mapped page by page into a two-level
+ * page table that translates guest addresses straight to host
+ * pointers, fronted by a small direct-mapped software TLB.
+ */
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stdint.h>
+#include "shell.h"
+#include "ckpt.h"
+
+#define MEM_PAGE_BITS   12
+#define MEM_PAGE_SIZE   (1ULL << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_L2_BITS     10
+#define MEM_L1_BITS     14      /* 36-bit guest address space */
+#define MEM_TLB_SIZE    16
+
+typedef struct {
+    uint64_t start, size;
+    uint8_t *mem;
+} mem_region_t;
+
+extern mem_region_t MEM_REGIONS[];
+extern const int MEM_NREGIONS;
+
+void mem_init();
+/* a new host thread starts with an empty TLB */
+void mem_tlb_flush();
+/* the pages the guest has touched */
+void mem_checkpoint(ckpt_t *ck);
+
+/* Stores a thread makes while it uses a buffer stay out of memory,
+ * seen only by its own loads, until the buffer is drained. The
+ * deterministic parallel mode (parallel.h) drains them at barriers. */
+typedef struct mem_buffer mem_buffer_t;
+mem_buffer_t *mem_buffer_new();
+void mem_buffer_free(mem_buffer_t *b);
+/* NULL to store straight to memory again */
+void mem_buffer_use(mem_buffer_t *b);
+void mem_buffer_drain(mem_buffer_t *b);
+
+uint8_t  mem_read_8(uint64_t address);
+uint16_t mem_read_16(uint64_t address);
+uint64_t mem_read_64(uint64_t address);
+void     mem_write_8(uint64_t address, uint8_t value);
+void     mem_write_16(uint64_t address, uint16_t value);
+void     mem_write_64(uint64_t address, uint64_t value);
+
+#endif
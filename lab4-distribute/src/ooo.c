@@ -0,0 +1,364 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Out-of-order core, used with -core=ooo. Instructions leave the
+ * shared front end in order at dispatch, where the register alias
+ * table renames their sources to the ROB entries producing them. They
+ * wait in a unified issue queue until those producers have finished,
+ * issue oldest first, and retire in order from the head of the ROB.
+ *
+ * As in the wide pipeline, each instruction executes functionally
+ * when it dispatches, so the architectural state is exactly the
+ * in-order result and the ROB only has to model time. A mispredicted
+ * branch stops dispatch until it issues, and fetch is redirected
+ * then; the wrong-path instructions fetched meanwhile are squashed
+ * without ever dispatching.
+ */
+
+#include "front.h"
+#include "config.h"
+#include "core.h"
+#include "shell.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+typedef struct {
+    fetch_slot_t slot;
+    int src_count;
+    uint64_t src[2];        /* sequence numbers of the producers */
+    bool issued;
+    uint64_t done_at;       /* cycle the result can be read */
+    bool mispredicted;      /* redirect fetch to target when it issues */
+    uint64_t target;
+} rob_entry_t;
+
+static int width;
+
+/* Sequence numbers start at 1 so 0 can mean "no producer". The entry
+ * for seq is rob[seq % rob_size]; it is in flight while
+ * head_seq <= seq < next_seq. */
+static __thread rob_entry_t *rob;
+static __thread uint64_t head_seq, next_seq;
+static __thread uint64_t rat[ARM_REGS + 1];
+
+static __thread uint64_t *iq;               /* sequence numbers, oldest first */
+static __thread int iq_count;
+static __thread int lsq_count;              /* loads and stores in the ROB */
+
+static __thread uint64_t redirect_seq;      /* mispredicted branch dispatch waits on */
+static __thread bool halted;                /* HLT has dispatched */
+
+/* blocking dcache access, when the MSHRs cannot take it */
+static __thread int lsu_wait;
+static __thread uint64_t lsu_addr;
+static __thread int ports_used;
+
+/* statistics */
+static __thread uint64_t retired;
+static __thread uint64_t rob_occupancy;
+static __thread uint64_t stall_rob, stall_iq, stall_lsq, stall_branch;
+static __thread uint64_t load_forwards, load_misses;
+
+void ooo_init()
+{
+    width = config.width;
+    if (width < 1 || width > FRONT_MAX_WIDTH) {
+        printf("Error: pipeline width must be between 1 and %d\n", FRONT_MAX_WIDTH);
+        exit(-1);
+    }
+    if (config.rob_size < 1 || config.iq_size < 1 || config.lsq_size < 1 ||
+        config.dcache_ports < 1) {
+        printf("Error: ROB, issue queue, LSQ and dcache ports need at least one entry\n");
+        exit(-1);
+    }
+    front_init();
+    rob = calloc(config.rob_size, sizeof(rob_entry_t));
+    iq = calloc(config.iq_size, sizeof(uint64_t));
+    head_seq = next_seq = 1;
+    memset(rat, 0, sizeof(rat));
+    iq_count = lsq_count = 0;
+    redirect_seq = 0;
+    halted = false;
+    lsu_wait = 0;
+    retired = rob_occupancy = 0;
+    stall_rob = stall_iq = stall_lsq = stall_branch = 0;
+    load_forwards = load_misses = 0;
+}
+
+static inline rob_entry_t *rob_entry(uint64_t seq)
+{
+    return &rob[seq % config.rob_size];
+}
+
+static bool produced(uint64_t seq)
+{
+    if (seq < head_seq)
+        return true;
+    rob_entry_t *e = rob_entry(seq);
+    return e->issued && e->done_at <= stat_cycles;
+}
+
+static bool memory_free()
+{
+    return !lsu_wait && ports_used < config.dcache_ports;
+}
+
+/* Blocking access for when cache_issue declines; returns the cycles
+ * until the data is there and holds the dcache for that long. */
+static int ooo_access(uint64_t addr, uint64_t pc, bool write)
+{
+    ports_used++;
+    int pending = cache_issue(pipe.dcache, addr, pc, stat_cycles, write);
+    if (pending >= 0)
+        return pending;
+
+    int wait = write ? cache_write(pipe.dcache, addr, pc) :
+                       cache_update(pipe.dcache, addr, pc);
+    if (wait) {
+        lsu_wait = wait;
+        lsu_addr = addr;
+        pipe.dcache->waiting = true;
+    }
+    return wait;
+}
+
+/* The youngest older store to the same doubleword, 0 if none. */
+static uint64_t older_store(uint64_t seq)
+{
+    uint64_t addr = rob_entry(seq)->slot.address >> 3;
+    for (uint64_t s = seq - 1; s >= head_seq; s--) {
+        fetch_slot_t *slot = &rob_entry(s)->slot;
+        if (slot->operation.is_store && slot->address >> 3 == addr)
+            return s;
+    }
+    return 0;
+}
+
+static bool ooo_issue_one(rob_entry_t *e, uint64_t seq)
+{
+    for (int i = 0; i < e->src_count; i++) {
+        if (!produced(e->src[i]))
+            return false;
+    }
+
+    Pipe_Op *op = &e->slot.operation;
+    e->done_at = stat_cycles + 1;
+    if (op->is_load) {
+        uint64_t store = older_store(seq);
+        if (store) {
+            if (!rob_entry(store)->issued)
+                return false;
+            load_forwards++;
+        }
+        else {
+            if (!memory_free())
+                return false;
+            int latency = ooo_access(e->slot.address, e->slot.PC, false);
+            load_misses += latency > 0;
+            e->done_at += latency;
+        }
+    }
+    e->issued = true;
+    if (e->mispredicted) {
+        front_redirect(e->target);
+        redirect_seq = 0;
+    }
+    return true;
+}
+
+static void ooo_issue()
+{
+    int issued = 0;
+    int kept = 0;
+    for (int i = 0; i < iq_count; i++) {
+        uint64_t seq = iq[i];
+        if (issued < width && ooo_issue_one(rob_entry(seq), seq))
+            issued++;
+        else
+            iq[kept++] = seq;
+    }
+    iq_count = kept;
+}
+
+/* stores write the dcache when they retire */
+static void ooo_retire()
+{
+    for (int i = 0; i < width && head_seq < next_seq; i++) {
+        rob_entry_t *e = rob_entry(head_seq);
+        Pipe_Op *op = &e->slot.operation;
+        if (!e->issued || e->done_at > stat_cycles)
+            break;
+        if (op->is_store) {
+            if (!memory_free())
+                break;
+            ooo_access(e->slot.address, e->slot.PC, true);
+        }
+
+        lsq_count -= op->type == DTYPE;
+        head_seq++;
+        stat_inst_retire++;
+        retired++;
+        if (op->opcode == OPCODE_HLT) {
+            RUN_BIT = FALSE;
+            break;
+        }
+    }
+}
+
+static void ooo_dispatch()
+{
+    for (int i = 0; i < width; i++) {
+        fetch_slot_t *s = front_peek();
+        if (halted || !s)
+            return;
+        if (redirect_seq) {
+            stall_branch++;
+            return;
+        }
+        if (next_seq - head_seq == config.rob_size) {
+            stall_rob++;
+            return;
+        }
+        if (iq_count == config.iq_size) {
+            stall_iq++;
+            return;
+        }
+        if (s->operation.type == DTYPE && lsq_count == config.lsq_size) {
+            stall_lsq++;
+            return;
+        }
+
+        uint64_t seq = next_seq++;
+        rob_entry_t *e = rob_entry(seq);
+        memset(e, 0, sizeof(*e));
+        e->slot = *s;
+        front_pop();
+
+        uint8_t regs[2];
+        int count = slot_sources(&e->slot, regs);
+        for (int j = 0; j < count; j++) {
+            if (rat[regs[j]] >= head_seq)
+                e->src[e->src_count++] = rat[regs[j]];
+        }
+
+        uint64_t next = slot_execute(&e->slot);
+        Pipe_Op *op = &e->slot.operation;
+        if (op->mod_reg && op->Rt != 31)
+            rat[op->Rt] = seq;
+        if (op->flagSet)
+            rat[FLAGS_REG] = seq;
+        lsq_count += op->type == DTYPE;
+        iq[iq_count++] = seq;
+
+        if (slot_resolve(&e->slot, next)) {
+            e->mispredicted = true;
+            e->target = next;
+            redirect_seq = seq;
+        }
+        if (HLT) {
+            front_halt(&e->slot);
+            halted = true;
+        }
+    }
+}
+
+void ooo_cycle()
+{
+    cache_tick(pipe.icache, stat_cycles);
+    cache_tick(pipe.dcache, stat_cycles);
+
+    ports_used = 0;
+    if (lsu_wait && --lsu_wait == 0) {
+        pipe.dcache->waiting = false;
+        cache_complete(pipe.dcache, lsu_addr);
+    }
+    rob_occupancy += next_seq - head_seq;
+
+    ooo_retire();
+    if (!RUN_BIT)
+        return;
+    ooo_issue();
+    ooo_dispatch();
+    front_fetch(width);
+}
+
+bool ooo_idle()
+{
+    return head_seq == next_seq && !lsu_wait && front_idle();
+}
+
+void ooo_free()
+{
+    free(rob);
+    free(iq);
+    rob = NULL;
+    iq = NULL;
+}
+
+void ooo_checkpoint(ckpt_t *ck)
+{
+    ckpt_section(ck, "ooo");
+    ckpt_blob(ck, rob, config.rob_size * sizeof(rob_entry_t));
+    ckpt_var(ck, head_seq);
+    ckpt_var(ck, next_seq);
+    ckpt_var(ck, rat);
+    ckpt_blob(ck, iq, config.iq_size * sizeof(uint64_t));
+    ckpt_var(ck, iq_count);
+    ckpt_var(ck, lsq_count);
+    ckpt_var(ck, redirect_seq);
+    ckpt_var(ck, halted);
+    ckpt_var(ck, lsu_wait);
+    ckpt_var(ck, lsu_addr);
+    ckpt_var(ck, ports_used);
+    ckpt_var(ck, retired);
+    ckpt_var(ck, rob_occupancy);
+    ckpt_var(ck, stall_rob);
+    ckpt_var(ck, stall_iq);
+    ckpt_var(ck, stall_lsq);
+    ckpt_var(ck, stall_branch);
+    ckpt_var(ck, load_forwards);
+    ckpt_var(ck, load_misses);
+}
+
+void ooo_core_vars()
+{
+    CORE_VAR(rob);
+    CORE_VAR(head_seq);
+    CORE_VAR(next_seq);
+    CORE_VAR(rat);
+    CORE_VAR(iq);
+    CORE_VAR(iq_count);
+    CORE_VAR(lsq_count);
+    CORE_VAR(redirect_seq);
+    CORE_VAR(halted);
+    CORE_VAR(lsu_wait);
+    CORE_VAR(lsu_addr);
+    CORE_VAR(ports_used);
+    CORE_VAR(retired);
+    CORE_VAR(rob_occupancy);
+    CORE_VAR(stall_rob);
+    CORE_VAR(stall_iq);
+    CORE_VAR(stall_lsq);
+    CORE_VAR(stall_branch);
+    CORE_VAR(load_forwards);
+    CORE_VAR(load_misses);
+}
+
+void ooo_print_stats()
+{
+    uint64_t cycles = stat_cycles ? stat_cycles : 1;
+    printf("Out-of-order core: width %d, ROB %d, IQ %d, LSQ %d\n",
+           width, config.rob_size, config.iq_size, config.lsq_size);
+    printf("  IPC %.3f  avg ROB occupancy %.2f  squashed %" PRIu64 "\n",
+           (double)retired / cycles, (double)rob_occupancy / cycles,
+           front_squashed());
+    printf("  dispatch stalls: ROB full %" PRIu64 "  IQ full %" PRIu64
+           "  LSQ full %" PRIu64 "  branch %" PRIu64 "\n",
+           stall_rob, stall_iq, stall_lsq, stall_branch);
+    printf("  loads: forwarded %" PRIu64 "  missed %" PRIu64 "\n",
+           load_forwards, load_misses);
+}
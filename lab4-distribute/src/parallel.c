@@ -0,0 +1,411 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "parallel.h"
+#include "coherence.h"
+#include "config.h"
+#include "core.h"
+#include "mem.h"
+#include "pipe.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RING_SIZE 256       /* snoops in flight from one core to another */
+#define CLAIMS 1024         /* peers' blocks a core remembers snooping */
+
+enum { EVENT_MISS, EVENT_WRITE, EVENT_SNOOP_READ, EVENT_SNOOP_WRITE, EVENT_TEXT };
+
+/* traffic below a core's L1s, or a snoop held for the barrier */
+typedef struct {
+    uint64_t cycle;
+    uint64_t addr;
+    cache_t *c;
+    int kind;
+    int core;               /* whose log */
+} parallel_event_t;
+
+typedef struct {
+    uint64_t addr;
+    bool write;
+} snoop_t;
+
+/* one producer and one consumer, each owning its index */
+typedef struct {
+    snoop_t slots[RING_SIZE];
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail __attribute__((aligned(64)));
+} ring_t;
+
+/* A peer's L1D copy only shows the peer as the quantum began, so the
+ * first snoop of a block is all it answers for, until the block is
+ * snooped back from us. */
+typedef struct {
+    uint64_t key;           /* block and peer, + 1 */
+    uint64_t quantum;
+    bool write;
+} claim_t;
+
+typedef struct {
+    int core;
+    pthread_t thread;
+    bool started;           /* this run */
+    bool halted;
+    uint32_t halt_cycle;
+    uint32_t cycles, retired, fetched, squashed;
+    parallel_event_t *log;
+    size_t log_count, log_size;
+    cache_t *snapshot;      /* the L1D as the last barrier left it */
+    claim_t *claims;
+    mem_buffer_t *stores;   /* deterministic mode */
+    int pending __attribute__((aligned(64)));   /* something in a ring for us */
+} worker_t;
+
+static worker_t *workers;
+static parallel_event_t **merged;   /* the logs in cycle order */
+static size_t merged_size;
+static ring_t *rings;       /* from core i to core j at i * cores + j */
+static pthread_barrier_t barrier;
+static uint64_t quantum;    /* the one under way */
+static uint64_t quantum_cycles;     /* 0 to stop */
+static uint64_t *text_written;      /* by the last quantum's stores */
+static size_t text_count, text_size;
+
+static __thread worker_t *self;
+
+static void parallel_log(cache_t *c, uint64_t addr, uint64_t cycle, int kind)
+{
+    if (self->log_count == self->log_size) {
+        self->log_size = self->log_size ? 2 * self->log_size : 1024;
+        self->log = realloc(self->log, self->log_size * sizeof(parallel_event_t));
+    }
+    self->log[self->log_count++] = (parallel_event_t){ cycle, addr, c, kind, self->core };
+}
+
+void parallel_defer(cache_t *c, uint64_t addr, uint64_t cycle, bool write)
+{
+    parallel_log(c, addr, cycle, write ? EVENT_WRITE : EVENT_MISS);
+}
+
+void parallel_text_written(uint64_t address)
+{
+    parallel_log(NULL, address, stat_cycles, EVENT_TEXT);
+}
+
+static void parallel_send(int core, uint64_t addr, bool write)
+{
+    if (!config.parallel_deterministic) {
+        ring_t *r = &rings[self->core * config.cores + core];
+        uint32_t tail = r->tail;
+        if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) < RING_SIZE) {
+            r->slots[tail % RING_SIZE] = (snoop_t){ addr, write };
+            __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&workers[core].pending, 1, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+    parallel_log(coherence_l1d(core), addr, stat_cycles,
+                 write ? EVENT_SNOOP_WRITE : EVENT_SNOOP_READ);
+}
+
+static claim_t *parallel_claim(worker_t *w, uint64_t block, int core)
+{
+    uint64_t key = (block * MAX_CORES + core) + 1;
+    return &w->claims[(key * 0x9E3779B97F4A7C15ULL) >> 32 & (CLAIMS - 1)];
+}
+
+int parallel_snoop(int core, uint64_t addr, bool write)
+{
+    cache_t *copy = workers[core].snapshot;
+    int held = cache_holds(copy, addr);
+    if (held < 0)
+        return -1;
+
+    uint64_t block = addr >> copy->block_bits;
+    uint64_t key = (block * MAX_CORES + core) + 1;
+    claim_t *claim = parallel_claim(self, block, core);
+    if (claim->key == key && claim->quantum == quantum) {
+        /* invalidated already, or already clean */
+        if (claim->write)
+            return -1;
+        if (!write)
+            return 0;
+    }
+    *claim = (claim_t){ key, quantum, write };
+    parallel_send(core, addr, write);
+    return held;
+}
+
+/* Apply the snoops waiting for core. On its own thread, a peer that
+ * took a block back may hold it again, so the claims on it go. */
+static void parallel_receive(int core)
+{
+    if (!__atomic_exchange_n(&workers[core].pending, 0, __ATOMIC_ACQ_REL))
+        return;
+    cache_t *l1d = coherence_l1d(core);
+    for (int from = 0; from < config.cores; from++) {
+        ring_t *r = &rings[from * config.cores + core];
+        uint32_t head = r->head;
+        uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            snoop_t *s = &r->slots[head % RING_SIZE];
+            if (s->write)
+                cache_snoop_write(l1d, s->addr);
+            else
+                cache_snoop_read(l1d, s->addr);
+            if (self)
+                parallel_claim(self, s->addr >> l1d->block_bits, from)->key = 0;
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void *parallel_thread(void *arg)
+{
+    worker_t *w = arg;
+    self = w;
+    mem_tlb_flush();
+    core_bind(w->core);
+    stat_cycles = w->cycles;
+    stat_inst_retire = stat_inst_fetch = stat_squash = 0;
+    if (config.parallel_deterministic)
+        mem_buffer_use(w->stores);
+
+    for (;;) {
+        pthread_barrier_wait(&barrier);
+        if (!w->halted) {
+            for (size_t i = 0; i < text_count; i++)
+                predecode_invalidate(text_written[i]);
+        }
+        if (quantum_cycles == 0)
+            break;
+        for (uint64_t i = 0; i < quantum_cycles && !w->halted; i++) {
+            parallel_receive(w->core);
+            if (!core_step()) {
+                /* core_finish reports it at the barrier */
+                w->halted = true;
+                w->halt_cycle = stat_cycles;
+                core_unbind();
+            }
+            stat_cycles++;
+        }
+        pthread_barrier_wait(&barrier);
+    }
+
+    if (!w->halted)
+        core_unbind();
+    mem_buffer_use(NULL);
+    w->cycles = stat_cycles;
+    w->retired = stat_inst_retire;
+    w->fetched = stat_inst_fetch;
+    w->squashed = stat_squash;
+    return NULL;
+}
+
+static void parallel_apply(const parallel_event_t *e)
+{
+    switch (e->kind) {
+        case EVENT_MISS:        cache_below(e->c, e->addr, e->cycle, false); break;
+        case EVENT_WRITE:       cache_below(e->c, e->addr, e->cycle, true); break;
+        case EVENT_SNOOP_READ:  cache_snoop_read(e->c, e->addr); break;
+        case EVENT_SNOOP_WRITE: cache_snoop_write(e->c, e->addr); break;
+        case EVENT_TEXT:
+            if (text_count == text_size) {
+                text_size = text_size ? 2 * text_size : 64;
+                text_written = realloc(text_written, text_size * sizeof(uint64_t));
+            }
+            text_written[text_count++] = e->addr;
+            break;
+    }
+}
+
+/* a block and core the pass below has met a write snoop from */
+typedef struct {
+    uint64_t key;           /* block and core, + 1 */
+    uint64_t quantum;       /* + 1, so a zeroed slot is empty */
+} seen_t;
+
+static seen_t *seen;
+static size_t seen_size;
+
+/* whether the pass has met (block, core), marking it if mark */
+static bool parallel_seen(uint64_t block, int core, bool mark)
+{
+    uint64_t key = (block * MAX_CORES + core) + 1;
+    size_t i = (key * 0x9E3779B97F4A7C15ULL) >> 32 & (seen_size - 1);
+    while (seen[i].quantum == quantum + 1 && seen[i].key != key)
+        i = (i + 1) & (seen_size - 1);
+    bool found = seen[i].quantum == quantum + 1;
+    if (mark)
+        seen[i] = (seen_t){ key, quantum + 1 };
+    return found;
+}
+
+/* A held write snoop on a core that writes the block itself later in
+ * the quantum is dropped. Had it gone out at once, that core would have
+ * missed and taken the block back, so it is the one left holding it.
+ * One pass from the newest event back finds them, leaving NULL. */
+static void parallel_drop_overtaken(size_t count)
+{
+    if (seen_size < 2 * count) {
+        while (seen_size < 2 * count)
+            seen_size = seen_size ? 2 * seen_size : 1024;
+        free(seen);
+        seen = calloc(seen_size, sizeof(seen_t));
+    }
+    for (size_t i = count; i-- > 0; ) {
+        const parallel_event_t *e = merged[i];
+        if (e->kind != EVENT_SNOOP_WRITE)
+            continue;
+        uint64_t block = e->addr >> e->c->block_bits;
+        bool overtaken = parallel_seen(block, e->c->core, false);
+        parallel_seen(block, e->core, true);
+        if (overtaken)
+            merged[i] = NULL;
+    }
+}
+
+/* Every thread is waiting: settle what the quantum left for the
+ * shared state, in an order the host's scheduling doesn't change. */
+static void parallel_barrier()
+{
+    for (int c = 0; c < config.cores; c++) {
+        if (coherence_l1d(c))
+            parallel_receive(c);
+    }
+
+    text_count = 0;
+
+    /* the cores' logs, merged oldest first */
+    size_t next[MAX_CORES] = { 0 };
+    size_t count = 0;
+    for (;;) {
+        worker_t *oldest = NULL;
+        for (int c = 0; c < config.cores; c++) {
+            worker_t *w = &workers[c];
+            if (next[c] < w->log_count &&
+                    (!oldest || w->log[next[c]].cycle < oldest->log[next[oldest->core]].cycle))
+                oldest = w;
+        }
+        if (!oldest)
+            break;
+        if (count == merged_size) {
+            merged_size = merged_size ? 2 * merged_size : 1024;
+            merged = realloc(merged, merged_size * sizeof(parallel_event_t *));
+        }
+        merged[count++] = &oldest->log[next[oldest->core]++];
+    }
+    parallel_drop_overtaken(count);
+    for (size_t i = 0; i < count; i++) {
+        if (merged[i])
+            parallel_apply(merged[i]);
+    }
+    for (int c = 0; c < config.cores; c++)
+        workers[c].log_count = 0;
+
+    if (config.parallel_deterministic) {
+        for (int c = 0; c < config.cores; c++)
+            mem_buffer_drain(workers[c].stores);
+    }
+
+    for (int c = 0; c < config.cores; c++) {
+        worker_t *w = &workers[c];
+        if (w->halted && core_running(c)) {
+            stat_cycles = w->halt_cycle;
+            core_finish(c);
+        }
+    }
+
+    /* the next quantum's snoops see the snoops and stores above */
+    for (int c = 0; c < config.cores; c++) {
+        if (coherence_l1d(c))
+            workers[c].snapshot = cache_snapshot(coherence_l1d(c), workers[c].snapshot);
+    }
+}
+
+static void parallel_setup()
+{
+    int n = config.cores;
+    workers = calloc(n, sizeof(worker_t));
+    rings = calloc((size_t)n * n, sizeof(ring_t));
+    for (int c = 0; c < n; c++) {
+        workers[c].core = c;
+        workers[c].claims = calloc(CLAIMS, sizeof(claim_t));
+        workers[c].stores = mem_buffer_new();
+    }
+}
+
+uint64_t parallel_run(uint64_t cycles)
+{
+    int n = config.cores;
+    int current = current_core;
+    uint32_t start = stat_cycles;
+    uint64_t run = 0;
+
+    if (!workers)
+        parallel_setup();
+    /* the threads take every core from its saved state */
+    core_save(current_core);
+    int threads = 0;
+    for (int c = 0; c < n; c++) {
+        if (core_running(c))
+            threads++;
+    }
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+    for (int c = 0; c < n; c++) {
+        worker_t *w = &workers[c];
+        if (!core_running(c))
+            continue;
+        w->started = true;
+        w->halted = false;
+        w->cycles = start;
+        w->snapshot = cache_snapshot(coherence_l1d(c), w->snapshot);
+        if (pthread_create(&w->thread, NULL, parallel_thread, w)) {
+            printf("Error: can't start a thread for core %d\n", c);
+            exit(-1);
+        }
+    }
+
+    bool any = true;
+    while (any && run < cycles) {
+        quantum_cycles = cycles - run < (uint64_t)config.parallel_quantum ?
+                         cycles - run : (uint64_t)config.parallel_quantum;
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+        parallel_barrier();
+        quantum++;
+
+        any = false;
+        uint32_t last = start;
+        for (int c = 0; c < n; c++) {
+            any |= core_running(c);
+            if (workers[c].halted && workers[c].halt_cycle + 1 > last)
+                last = workers[c].halt_cycle + 1;
+        }
+        /* the quantum ends early when the last core halts in it */
+        run += any ? quantum_cycles : last - (start + run);
+    }
+    quantum_cycles = 0;
+    pthread_barrier_wait(&barrier);
+
+    for (int c = 0; c < n; c++) {
+        worker_t *w = &workers[c];
+        if (!w->started)
+            continue;
+        pthread_join(w->thread, NULL);
+        w->started = false;
+        stat_inst_retire += w->retired;
+        stat_inst_fetch += w->fetched;
+        stat_squash += w->squashed;
+    }
+    pthread_barrier_destroy(&barrier);
+    stat_cycles = start + run;
+
+    current_core = current;
+    core_load(current);
+    RUN_BIT = any;
+    return run;
+}
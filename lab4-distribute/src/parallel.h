@@ -0,0 +1,47 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Host-parallel multi-core (-parallel=1). Each core runs on a host
+ * thread of its own for -parallel_quantum cycles at a time, and then
+ * every thread waits at a barrier. During a quantum a core touches
+ * only its own state. Its misses and writebacks are logged, and the
+ * shared L2, LLC and memory channel replay them in cycle order at the
+ * barrier; the latency the core saw came from those levels as they
+ * stood when the quantum began, so cores contending for them run
+ * ahead of a sequential run by up to a quantum of that contention.
+ * The default quantum keeps barriers rare; -parallel_quantum=1 is the
+ * one for accuracy. A snoop is judged against a copy of the peer's
+ * L1D taken at the last barrier, and reaches the peer through a
+ * lock-free queue the peer empties every cycle. Each thread keeps its own
+ * predecode table, and a store to the text reaches the others' at the
+ * barrier.
+ *
+ * -parallel_deterministic=1 holds the snoops back until the barrier as
+ * well, along with every store, so a run doesn't depend on how the host
+ * schedules its threads. When two cores write a block in the same
+ * quantum, the later writer keeps it.
+ */
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "cache.h"
+
+/* Run every core for up to cycles cycles, stopping early once they
+ * have all halted. Returns the cycles run. */
+uint64_t parallel_run(uint64_t cycles);
+
+/* From a core thread: c's miss (write false) or written-back block at
+ * cycle, for the shared levels. */
+void parallel_defer(cache_t *c, uint64_t addr, uint64_t cycle, bool write);
+
+/* From a core thread: a store to the text at address. Every core's
+ * predecode table drops the word before the next quantum. */
+void parallel_text_written(uint64_t address);
+
+/* From a core thread: snoop core's L1D. Returns as cache_snoop_read
+ * and cache_snoop_write do. */
+int parallel_snoop(int core, uint64_t addr, bool write);
+
+#endif
@@ -5,47 +5,170 @@
 */
 
 #include "pipe.h"
+#include "isa.h"
+#include "front.h"
+#include "core.h"
+#include "coherence.h"
+#include "config.h"
+#include "trace.h"
+#include "pipetrace.h"
 #include "shell.h"
 #include <stdio.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <time.h>
 
-#define RTYPE 6
-#define ITYPE 1
-#define DTYPE 2
-#define BTYPE 3
-#define CTYPE 4
-#define IWTYPE 5
-#define BUBBLE 10
-
 /* global pipeline state */
-Pipe_State pipe;
+__thread Pipe_State pipe;
 
 /* global pipeline registers*/
-Pipe_Reg_IFtoDE IF_DE;
-Pipe_Reg_DEtoEX DE_EX;
-Pipe_Reg_EXtoMEM EX_MEM;
-Pipe_Reg_MEMtoWB MEM_WB;
-
-int RUN_BIT;
-int HLT;
-int STALL;
-static int prints = true; 
-static int prints2 = false; 
-
-/* static constant list of intruction type tuples */
-static const ins_type TYPE_LIST[6] = {
-    {BTYPE, 6},
-    {CTYPE, 8},
-    {ITYPE, 10},
-    {RTYPE, 11},
-    {DTYPE, 11},  
-    {IWTYPE, 11}
-};
-
-#define TYPE_LIST_SIZE (sizeof(TYPE_LIST) / sizeof(TYPE_LIST[0]))
+__thread Pipe_Reg_IFtoDE IF_DE;
+__thread Pipe_Reg_DEtoEX DE_EX;
+__thread Pipe_Reg_EXtoMEM EX_MEM;
+__thread Pipe_Reg_MEMtoWB MEM_WB;
+
+__thread int RUN_BIT;
+__thread int HLT;
+__thread int STALL;
+
+/* predecoded operations for the text region, one slot per word; the
+ * cores share them except on a parallel run */
+#define PREDECODE_SIZE (MEM_TEXT_SIZE >> 2)
+static __thread Pipe_Op *predecode;
+static __thread bool *predecode_valid;
+
+/* Fetch target queue. The predictor runs ahead of fetch, one
+ * prediction a cycle, and each entry maps a fetch address to the
+ * predicted next one. Empty (size 0) means fetch predicts for itself. */
+typedef struct {
+    uint64_t PC;
+    uint64_t next;
+} ftq_entry_t;
+
+static __thread ftq_entry_t *ftq;
+static __thread int ftq_head, ftq_count;
+static __thread uint64_t ftq_flushes, ftq_occupancy;
+
+static void ftq_flush()
+{
+    if (ftq_count)
+        ftq_flushes++;
+    ftq_head = 0;
+    ftq_count = 0;
+}
+
+/* extend the queue by one prediction and prefetch where it leads */
+static void ftq_fill()
+{
+    if (!ftq || HLT || ftq_count == config.ftq)
+        return;
+    uint64_t PC = ftq_count ? ftq[(ftq_head + ftq_count - 1) % config.ftq].next : pipe.PC;
+    uint64_t next = PC;
+    bp_predict(pipe.bp, &next);
+    ftq[(ftq_head + ftq_count) % config.ftq] = (ftq_entry_t){ PC, next };
+    ftq_count++;
+    cache_prefetch_block(pipe.icache, next);
+}
+
+/* the prediction for PC, from the queue when it has run ahead to it */
+static void ftq_next(uint64_t *PC)
+{
+    if (ftq_count && ftq[ftq_head].PC == *PC) {
+        *PC = ftq[ftq_head].next;
+        ftq_head = (ftq_head + 1) % config.ftq;
+        ftq_count--;
+        return;
+    }
+    ftq_flush();
+    bp_predict(pipe.bp, PC);
+}
+
+/* cycle each register's value arrives, for loads that missed in a
+ * non-blocking dcache */
+static __thread uint64_t reg_ready[ARM_REGS];
+
+/* the levels every core shares */
+static cache_t *shared_l2, *shared_llc;
+
+/* which timing model pipe_cycle runs */
+static enum { CORE_SCALAR, CORE_WIDE, CORE_OOO } core;
+
+/* pipe_drain: fetch is off, and the scalar pipeline notes where the
+ * last instruction to write back goes next */
+static __thread bool draining;
+static __thread bool committed;
+static __thread uint64_t committed_PC;
+
+/* -trace=pipe: instructions are numbered as they are fetched, and each
+ * cycle's record is built from the latches and counters */
+static __thread uint32_t fetch_seq;
+static pipe_trace_record_t trace_record;
+static Pipe_Op trace_wb;
+static uint64_t trace_imisses, trace_dmisses, trace_mispredicts, trace_flushes;
+
+static void forward_MEM_values(Pipe_Op operation);
+
+static void operands_load(Pipe_Operands *o, const Pipe_Op *op, const int64_t *regs)
+{
+    o->reg[0] = op->Rn;
+    o->reg[1] = op->Rm;
+    o->reg[2] = op->Rt;
+    for (int i = 0; i < 3; i++)
+        o->val[i] = regs[o->reg[i]];
+}
+
+static int64_t operand_read(const Pipe_Operands *o, uint8_t r)
+{
+    for (int i = 0; i < 3; i++) {
+        if (o->reg[i] == r)
+            return o->val[i];
+    }
+    return 0;
+}
+
+static void operand_write(Pipe_Operands *o, uint8_t r, int64_t v)
+{
+    for (int i = 0; i < 3; i++) {
+        if (o->reg[i] == r)
+            o->val[i] = v;
+    }
+}
+
+/* The ISA handlers index a register file; lay the slots out in one
+ * (only their entries are touched) and take the results back after. */
+static void operands_spill(const Pipe_Operands *o, int64_t *regs)
+{
+    for (int i = 0; i < 3; i++)
+        regs[o->reg[i]] = o->val[i];
+}
+
+static void operands_fill(Pipe_Operands *o, const int64_t *regs)
+{
+    for (int i = 0; i < 3; i++)
+        o->val[i] = regs[o->reg[i]];
+}
+
+static repl_policy_t config_repl(const char *name)
+{
+    int policy = repl_parse(name);
+    if (policy < 0) {
+        printf("Error: unknown replacement policy %s\n", name);
+        exit(-1);
+    }
+    return policy;
+}
+
+static prefetch_kind_t config_prefetch(const char *name)
+{
+    int kind = prefetch_parse(name);
+    if (kind < 0) {
+        printf("Error: unknown prefetcher %s\n", name);
+        exit(-1);
+    }
+    return kind;
+}
 
 void pipe_init()
 {
@@ -56,16 +179,201 @@ void pipe_init()
     STALL = FALSE;
     initialize_pipe_registers();
     pipe.bp = malloc(sizeof(bp_t));
-    bp_init(pipe.bp);
-    pipe.icache = cache_new(64, 4);
-    pipe.dcache = cache_new(256, 8);
+    bp_init(pipe.bp, config.bp, config.bp_history, config.bp_table_bits);
+    bp_init_btb(pipe.bp, config.btb_sets, config.btb_ways, config.btb_tag_bits,
+                config.ittage);
+    pipe.icache = cache_new(config.icache_block_size, config.icache_sets,
+                            config.icache_ways, config.icache_hit_latency,
+                            config.icache_miss_latency,
+                            config_repl(config.icache_repl));
+    pipe.dcache = cache_new(config.dcache_block_size, config.dcache_sets,
+                            config.dcache_ways, config.dcache_hit_latency,
+                            config.dcache_miss_latency,
+                            config_repl(config.dcache_repl));
+
+    /* L1I and L1D miss into a shared L2, which misses into the LLC; in
+     * a multi-core run every core shares the first one's */
+    if (current_core > 0) {
+        pipe.l2 = shared_l2;
+        pipe.llc = shared_llc;
+    }
+    else if (config.llc_sets) {
+        pipe.llc = cache_new(config.llc_block_size, config.llc_sets,
+                             config.llc_ways, config.llc_hit_latency,
+                             config.llc_miss_latency,
+                             config_repl(config.llc_repl));
+    }
+    if (config.l2_sets && current_core == 0) {
+        pipe.l2 = cache_new(config.l2_block_size, config.l2_sets,
+                            config.l2_ways, config.l2_hit_latency,
+                            config.l2_miss_latency,
+                            config_repl(config.l2_repl));
+        pipe.l2->next = pipe.llc;
+    }
+    shared_l2 = pipe.l2;
+    shared_llc = pipe.llc;
+    cache_t *below = pipe.l2 ? pipe.l2 : pipe.llc;
+    pipe.icache->next = below;
+    pipe.dcache->next = below;
+    cache_alloc_mshrs(pipe.dcache, config.dcache_mshrs);
+    cache_set_write_policy(pipe.dcache, config.dcache_write_back,
+                           config.dcache_write_allocate, config.write_buffer);
+    pipe.channel.write_cycles = config.mem_write_cycles;
+    cache_t *levels[] = { pipe.icache, pipe.dcache, pipe.l2, pipe.llc };
+    for (int i = 0; i < 4; i++) {
+        if (levels[i])
+            levels[i]->channel = &pipe.channel;
+    }
+    if (config.ftq < 0) {
+        printf("Error: ftq (%d) must be at least 0\n", config.ftq);
+        exit(-1);
+    }
+    prefetch_kind_t ipf = config_prefetch(config.icache_prefetch);
+    if (ipf == PREFETCH_NONE && config.ftq)
+        ipf = PREFETCH_FDIP;
+    cache_set_prefetcher(pipe.icache, ipf, config.prefetch_degree);
+    cache_set_prefetcher(pipe.dcache, config_prefetch(config.dcache_prefetch),
+                         config.prefetch_degree);
+    if (config.cores > 1)
+        coherence_attach(pipe.dcache, current_core);
+    memset(reg_ready, 0, sizeof(reg_ready));
+    if (!predecode || (config.parallel && current_core > 0)) {
+        predecode = calloc(PREDECODE_SIZE, sizeof(Pipe_Op));
+        predecode_valid = calloc(PREDECODE_SIZE, sizeof(bool));
+    }
+    ftq = config.ftq ? calloc(config.ftq, sizeof(ftq_entry_t)) : NULL;
+    ftq_head = ftq_count = 0;
+    ftq_flushes = ftq_occupancy = 0;
+    if (current_core == 0)
+        trace_init(config.trace, config.trace_file);
+    if (strcmp(config.core, "ooo") == 0) {
+        core = CORE_OOO;
+        ooo_init();
+    }
+    else if (strcmp(config.core, "inorder") == 0) {
+        core = config.width > 1 ? CORE_WIDE : CORE_SCALAR;
+        if (core == CORE_WIDE)
+            wide_init();
+    }
+    else {
+        printf("Error: unknown core %s (inorder, ooo)\n", config.core);
+        exit(-1);
+    }
+    fetch_seq = 0;
+    if (trace_mask & TRACE_PIPE) {
+        if (core != CORE_SCALAR) {
+            printf("Error: -trace=pipe records the scalar pipeline only\n");
+            exit(-1);
+        }
+        pipe_trace_header_t header = {
+            PIPE_TRACE_MAGIC, PIPE_TRACE_VERSION, PIPE_STAGES,
+            sizeof(pipe_trace_record_t)
+        };
+        trace_write(&header, sizeof(header));
+    }
+}
+
+static bool reg_pending(uint8_t reg)
+{
+    return reg != 31 && reg_ready[reg] > stat_cycles;
+}
+
+/* the operation about to execute reads a register still being filled */
+static bool operands_pending(const Pipe_Op *op)
+{
+    if (op->is_bubble)
+        return false;
+    switch (op->type) {
+        case RTYPE: return reg_pending(op->Rn) || reg_pending(op->Rm);
+        case ITYPE: return reg_pending(op->Rn);
+        case DTYPE: return reg_pending(op->Rn) || (op->is_store && reg_pending(op->Rt));
+        case CTYPE: return reg_pending(op->Rt);
+    }
+    return false;
+}
+
+static void pipe_trace_begin()
+{
+    trace_wb = MEM_WB.operation;
+    trace_imisses = pipe.icache->misses;
+    trace_dmisses = pipe.dcache->misses;
+    trace_mispredicts = pipe.bp->mispredicts;
+    trace_flushes = pipe.bp->flush_cycles;
+}
+
+/* called after MEM, before an MSHR wait can set STALL */
+static uint16_t pipe_trace_stall()
+{
+    if (pipe.dcache->waiting)
+        return PIPE_STALL_DCACHE;
+    if (STALL)
+        return PIPE_STALL_DATA;
+    if (operands_pending(&DE_EX.operation))
+        return PIPE_STALL_MSHR;
+    return 0;
+}
+
+static void pipe_trace_slot(pipe_trace_slot_t *slot, const Pipe_Op *op)
+{
+    if (op->is_bubble || op->seq == 0) {
+        memset(slot, 0, sizeof(*slot));
+        return;
+    }
+    slot->seq = op->seq;
+    slot->PC = op->PC;
+    slot->word = op->word;
+}
+
+static void pipe_trace_end(uint16_t stall)
+{
+    pipe_trace_record_t *r = &trace_record;
+    r->cycle = stat_cycles;
+    r->stall = stall;
+    if (pipe.icache->waiting)
+        r->stall |= PIPE_STALL_ICACHE;
+    if (pipe.bp->flush_cycles != trace_flushes)
+        r->stall |= PIPE_STALL_FLUSH;
+    r->events = 0;
+    if (pipe.icache->misses != trace_imisses)
+        r->events |= PIPE_EVENT_ICACHE_MISS;
+    if (pipe.dcache->misses != trace_dmisses)
+        r->events |= PIPE_EVENT_DCACHE_MISS;
+    if (pipe.bp->mispredicts != trace_mispredicts)
+        r->events |= PIPE_EVENT_MISPREDICT;
+    pipe_trace_slot(&r->stage[PIPE_IF], &IF_DE.operation);
+    pipe_trace_slot(&r->stage[PIPE_DE], &DE_EX.operation);
+    pipe_trace_slot(&r->stage[PIPE_EX], &EX_MEM.operation);
+    pipe_trace_slot(&r->stage[PIPE_MEM], &MEM_WB.operation);
+    pipe_trace_slot(&r->stage[PIPE_WB], &trace_wb);
+    trace_write(r, sizeof(*r));
 }
 
 void pipe_cycle()
 {  
+    if (core != CORE_SCALAR) {
+        if (core == CORE_OOO)
+            ooo_cycle();
+        else
+            wide_cycle();
+        if (!RUN_BIT && !core_threaded)
+            free_pipeline();
+        return;
+    }
+    bool tracing = trace_mask & TRACE_PIPE;
+    uint16_t stall = 0;
+    if (tracing)
+        pipe_trace_begin();
+    cache_tick(pipe.icache, stat_cycles);
+    cache_tick(pipe.dcache, stat_cycles);
+    ftq_occupancy += ftq_count;
     pipe_stage_wb();
+    bool running = RUN_BIT;
     if(RUN_BIT) {
         pipe_stage_mem();
+        if (tracing)
+            stall = pipe_trace_stall();
+        if (!STALL && !pipe.dcache->waiting && operands_pending(&DE_EX.operation))
+            STALL = true;
         if (!STALL)
         {   
             pipe_stage_execute();
@@ -80,14 +388,164 @@ void pipe_cycle()
             //     cache_insert(pipe.icache, IF_DE.PC);
             // }
         }
+        if (!draining)
+            ftq_fill();
     }
-    else{
+    if (tracing)
+        pipe_trace_end(stall);
+    if (!running && !core_threaded)
         free_pipeline();
+    TRACE(1, TRACE_CYCLE, "Pipe Cycle: %0" PRIX64 "\n", pipe.PC);
+}
+
+static bool latch_empty(const Pipe_Op *op)
+{
+    return op->is_bubble || op->word == 0;
+}
+
+static bool pipe_idle()
+{
+    switch (core) {
+        case CORE_WIDE: return wide_idle();
+        case CORE_OOO:  return ooo_idle();
+        case CORE_SCALAR: break;
+    }
+    return latch_empty(&IF_DE.operation) && latch_empty(&DE_EX.operation) &&
+           latch_empty(&EX_MEM.operation) && latch_empty(&MEM_WB.operation) &&
+           !pipe.dcache->waiting;
+}
+
+/* Let everything in flight finish without fetching anything new, so
+ * pipe.REGS and pipe.PC hold the architectural state. Returns the
+ * cycles it took, which count as simulated time. */
+int pipe_drain()
+{
+    int cycles = 0;
+    draining = true;
+    committed = false;
+    if (core != CORE_SCALAR)
+        front_stop();
+    while (RUN_BIT && !pipe_idle()) {
+        pipe_cycle();
+        stat_cycles++;
+        cycles++;
+    }
+    draining = false;
+    if (core == CORE_SCALAR && committed)
+        pipe.PC = committed_PC;
+    return cycles;
+}
+
+/* Start timing again from pipe.PC on a drained pipeline whose state
+ * may have been changed under it, e.g. by func_run. Cache and
+ * predictor contents are kept; anything in flight is finished. */
+void pipe_restart()
+{
+    cache_t *levels[] = { pipe.icache, pipe.dcache, pipe.l2, pipe.llc };
+    for (int i = 0; i < 4; i++) {
+        if (levels[i])
+            cache_settle(levels[i]);
+    }
+    initialize_pipe_registers();
+    STALL = false;
+    memset(reg_ready, 0, sizeof(reg_ready));
+    ftq_flush();
+    if (core != CORE_SCALAR)
+        front_restart();
+}
+
+void pipe_clear_stats()
+{
+    cache_t *levels[] = { pipe.icache, pipe.dcache, pipe.l2, pipe.llc };
+    for (int i = 0; i < 4; i++) {
+        if (levels[i])
+            cache_clear_stats(levels[i]);
+    }
+    bp_clear_stats(pipe.bp);
+}
+
+void pipe_read_counters(pipe_counters_t *c)
+{
+    cache_t *levels[] = { pipe.icache, pipe.dcache, pipe.l2, pipe.llc };
+    c->cycles = stat_cycles;
+    c->insts = stat_inst_retire;
+    for (int i = 0; i < 4; i++) {
+        c->accesses[i] = levels[i] ? levels[i]->accesses : 0;
+        c->misses[i] = levels[i] ? levels[i]->misses : 0;
+    }
+    c->branches = pipe.bp->branches;
+    c->mispredicts = pipe.bp->mispredicts;
+}
+
+/* The counters go with the caches when the program halts, so the
+ * window's end is read before every cycle; a window cut short by HLT
+ * misses the events of its last cycle. */
+void pipe_measure(uint32_t insts, pipe_counters_t *from, pipe_counters_t *to)
+{
+    pipe_read_counters(from);
+    *to = *from;
+    while (RUN_BIT && (uint32_t)(stat_inst_retire - from->insts) < insts) {
+        pipe_read_counters(to);
+        pipe_cycle();
+        stat_cycles++;
+    }
+    if (RUN_BIT)
+        pipe_read_counters(to);
+    to->cycles = stat_cycles;
+    to->insts = stat_inst_retire;
+}
+
+void pipe_checkpoint(ckpt_t *ck)
+{
+    Pipe_State keep = pipe;
+    ckpt_section(ck, "pipe");
+    ckpt_var(ck, pipe);
+    if (ckpt_loading(ck)) {
+        pipe.bp = keep.bp;
+        pipe.icache = keep.icache;
+        pipe.dcache = keep.dcache;
+        pipe.l2 = keep.l2;
+        pipe.llc = keep.llc;
     }
-    if (prints) printf("Pipe Cycle: %0lX\n", pipe.PC); 
+    ckpt_var(ck, IF_DE);
+    ckpt_var(ck, DE_EX);
+    ckpt_var(ck, EX_MEM);
+    ckpt_var(ck, MEM_WB);
+    ckpt_var(ck, RUN_BIT);
+    ckpt_var(ck, HLT);
+    ckpt_var(ck, STALL);
+    ckpt_var(ck, reg_ready);
+    ckpt_var(ck, fetch_seq);
+    ckpt_var(ck, ftq_head);
+    ckpt_var(ck, ftq_count);
+    ckpt_var(ck, ftq_flushes);
+    ckpt_var(ck, ftq_occupancy);
+    ckpt_blob(ck, ftq, config.ftq * sizeof(ftq_entry_t));
+    ckpt_var(ck, stat_cycles);
+    ckpt_var(ck, stat_inst_retire);
+    ckpt_var(ck, stat_inst_fetch);
+    ckpt_var(ck, stat_squash);
+
+    bp_checkpoint(pipe.bp, ck);
+    cache_t *levels[] = { pipe.icache, pipe.dcache, pipe.l2, pipe.llc };
+    for (int i = 0; i < 4; i++) {
+        if (levels[i])
+            cache_checkpoint(levels[i], ck);
+    }
+    if (core != CORE_SCALAR)
+        front_checkpoint(ck);
+    if (core == CORE_WIDE)
+        wide_checkpoint(ck);
+    if (core == CORE_OOO)
+        ooo_checkpoint(ck);
+
+    /* the text is about to be replaced */
+    if (ckpt_loading(ck))
+        memset(predecode_valid, 0, PREDECODE_SIZE * sizeof(bool));
 }
 
 void flush_pipeline() {
+    pipe.bp->flush_cycles++;
     EX_MEM.flushed = true;
     IF_DE.operation = initialize_operation();
     IF_DE.operation.is_bubble = true;
@@ -96,8 +554,11 @@ void flush_pipeline() {
 }
 
 void incr_PC(){
-    if (!HLT && !pipe.icache->waiting && !EX_MEM.flushed && !IF_DE.sec_stall) { 
-        bp_predict(pipe.bp, &pipe.PC);
+    if (!HLT && !draining && !pipe.icache->waiting && !EX_MEM.flushed && !IF_DE.sec_stall) { 
+        if (ftq)
+            ftq_next(&pipe.PC);
+        else
+            bp_predict(pipe.bp, &pipe.PC);
     }
 }
 
@@ -114,10 +575,10 @@ void pipe_stage_wb()
         STALL = false;
     }
     if(MEM_WB.operation.is_bubble) {
-        if(prints) printf("In WB      | BUBBLE\n");
+        TRACE(1, TRACE_WB, "In WB      | BUBBLE\n");
         return; 
     }
-    if(prints) printf("In WB      | word: %0X\n", MEM_WB.operation.word);
+    TRACE(1, TRACE_WB, "In WB      | word: %0X\n", MEM_WB.operation.word);
 
     // Update pipe
     Pipe_Op operation = MEM_WB.operation; 
@@ -127,19 +588,21 @@ void pipe_stage_wb()
     if (operation.mod_reg)
     {
         uint8_t Rt = operation.Rt;
-        pipe.REGS[Rt] = MEM_WB.REGS[Rt];
+        pipe.REGS[Rt] = operand_read(&MEM_WB.operands, Rt);
     }
     if (operation.flagSet) {
         pipe.FLAG_N = MEM_WB.FLAG_N; 
         pipe.FLAG_Z = MEM_WB.FLAG_Z;
-        if(prints2) printf("PIPE Flag_Z: %0X\n", pipe.FLAG_Z);
-        if(prints2) printf("PIPE Flag_N: %0X\n", pipe.FLAG_N);
+        TRACE(2, TRACE_WB, "PIPE Flag_Z: %0X\n", pipe.FLAG_Z);
+        TRACE(2, TRACE_WB, "PIPE Flag_N: %0X\n", pipe.FLAG_N);
     }
 
-    if (prints2) printf("Pipe.PC: %0lX\n", pipe.PC); 
+    TRACE(2, TRACE_WB, "Pipe.PC: %0" PRIX64 "\n", pipe.PC);
 
     if (MEM_WB.operation.opcode != 0) {
         stat_inst_retire += 1; 
+        committed = true;
+        committed_PC = operation.will_jump ? MEM_WB.PC : operation.PC + 4;
     }
     if (operation.opcode == 0x6A2) {
         RUN_BIT = FALSE;
@@ -150,7 +613,6 @@ void pipe_stage_wb()
 void pipe_stage_mem()
 {
     Pipe_Op operation = EX_MEM.operation;
-    int64_t *regs = EX_MEM.REGS;
     EX_MEM.flushed = false;
     if (pipe.dcache->waiting){
         pipe.dcache->cycles--;
@@ -159,7 +621,7 @@ void pipe_stage_mem()
             operation.is_bubble = false;
             int64_t DT_address = operation.address;
             uint8_t Rn = operation.Rn;
-            cache_insert(pipe.dcache, regs[Rn] + DT_address);
+            cache_complete(pipe.dcache, operand_read(&EX_MEM.operands, Rn) + DT_address);
         }
         else{
             MEM_WB.operation.is_bubble = true;
@@ -169,100 +631,71 @@ void pipe_stage_mem()
     }
     if (operation.is_bubble) {
         MEM_WB.operation = EX_MEM.operation; 
-        if(prints) printf("In MEM     | BUBBLE\n");
+        TRACE(1, TRACE_MEM, "In MEM     | BUBBLE\n");
 
         return;
     }
  
     uint64_t PC = EX_MEM.PC; 
     uint8_t type = operation.type; 
-    uint16_t opcode = operation.opcode;
 
-    if (!EX_MEM.stalled) forward_MEM_EX(operation);
+    /* after a wait the hazards were dealt with when it began */
+    bool resumed = EX_MEM.stalled;
+    if (!resumed) forward_MEM_EX(operation);
 
     if (type == DTYPE) {
         int64_t DT_address = operation.address;
-        uint8_t op = operation.misc;
         uint8_t Rn = operation.Rn;
-        uint8_t Rt = operation.Rt;
 
-        if (cache_update(pipe.dcache, regs[Rn] + DT_address) == 1){
+        uint64_t addr = operand_read(&EX_MEM.operands, Rn) + DT_address;
+
+        /* a miss that gets an MSHR lets the pipeline carry on; only a
+         * consumer of the loaded register waits for the fill */
+        int pending = cache_issue(pipe.dcache, addr, operation.PC, stat_cycles,
+                                  operation.is_store);
+        int wait = 0;
+        if (pending < 0 && operation.is_store)
+            wait = cache_write(pipe.dcache, addr, operation.PC);
+        else if (pending < 0)
+            wait = cache_update(pipe.dcache, addr, operation.PC);
+        if (operation.mod_reg)
+            reg_ready[operation.Rt] = 0;
+        if (pending > 0 && operation.is_load)
+            reg_ready[operation.Rt] = stat_cycles + pending;
+        if (wait){
+            TRACE(1, TRACE_CACHE, "dcache     | %" PRIX64 " waits %d\n", addr, wait);
             pipe.dcache->waiting = true;
             MEM_WB.operation.is_bubble = true;
-            pipe.dcache->cycles = 50;
+            pipe.dcache->cycles = wait;
             STALL = false;
             EX_MEM.stalled = true;
             return;
         }
 
-        switch(opcode) {
-            case 0x7C2:  // LDUR
-            {
-                uint64_t low_half = mem_read_32(regs[Rn] + DT_address);        
-                uint64_t high_half = mem_read_32(regs[Rn] + DT_address + 4);
-                regs[Rt] = (high_half << 32) | low_half;
-                operation.mod_reg = true;
-                break;
-            }
-            case 0x5C2:  // LDUR (32-bit)
-                regs[Rt] = mem_read_32(regs[Rn] + DT_address); 
-                operation.mod_reg = true;
-                break;   
-            case 0x1C2:  // LDURB
-                regs[Rt] = (mem_read_32(regs[Rn] + DT_address) & 0xFF);
-                operation.mod_reg = true;
-                break; 
-            case 0x3C2:  // LDURH
-                regs[Rt] = (mem_read_32(regs[Rn] + DT_address) & 0xFFFF);
-                operation.mod_reg = true;
-                break;
-            case 0x7C0:  // STUR
-            {
-                uint64_t wr_addr = regs[Rn] + DT_address;
-                int32_t first_half = regs[Rt] & 0xFFFFFFFF;
-                int32_t second_half = (regs[Rt] >> 32) & 0xFFFFFFFF;
-
-                mem_write_32(wr_addr, first_half);
-                mem_write_32(wr_addr + 4, second_half);
-                break;
-            }
-            case 0x5C0:  // STUR (32-bit)
-            {
-                int32_t write = regs[Rt] & 0xFFFFFFFF;
-
-                mem_write_32(regs[Rn] + DT_address, write);  
-                break;
-            }
-            case 0x1C0:  // STURB
-            {
-                uint64_t wr_addr = regs[Rn] + DT_address;
-                uint8_t write = regs[Rt] & 0xFF;
-                int32_t word = (mem_read_32(wr_addr) & 0xFFFFFF00) + write; 
-                mem_write_32(wr_addr, word);
-                break;
-            }
-            case 0x3C0:  // STURH
-            {
-                uint64_t wr_addr = regs[Rn] + DT_address;
-                uint16_t write = regs[Rt] & 0xFFFF;
-                int32_t word = (mem_read_32(wr_addr) & 0xFFFF0000) + write; 
-                mem_write_32(wr_addr, word);
-                break;
-            }
-            default:
-                printf("ERROR: Unknown Instruction in DTYPE\n");
-                RUN_BIT = FALSE;
+        const isa_entry_t *entry = isa_lookup(operation.word);
+        if (entry->memory) {
+            int64_t regs[ARM_REGS];
+            operands_spill(&EX_MEM.operands, regs);
+            entry->memory(&operation, regs);
+            operands_fill(&EX_MEM.operands, regs);
+        }
+        else {
+            printf("ERROR: Unknown Instruction in DTYPE\n");
+            RUN_BIT = FALSE;
         }
-
     }
     
+    /* the wait stood in for the load-use bubble, so execute, which has
+     * yet to run this cycle, takes the value from here */
+    if (resumed) forward_MEM_values(operation);
+
     EX_MEM.stalled = false;
-    memcpy(MEM_WB.REGS, regs, ARM_REGS * sizeof(int64_t));
+    MEM_WB.operands = EX_MEM.operands;
     MEM_WB.operation = operation; 
     MEM_WB.PC = PC; 
     MEM_WB.FLAG_N = EX_MEM.FLAG_N; 
     MEM_WB.FLAG_Z = EX_MEM.FLAG_Z; 
-    if(prints) printf("In MEM     | word: %0X\n", EX_MEM.operation.word);
+    TRACE(1, TRACE_MEM, "In MEM     | word: %0X\n", EX_MEM.operation.word);
 }
 
 void pipe_stage_execute()
@@ -270,232 +703,62 @@ void pipe_stage_execute()
     EX_MEM.flushed = false;
     if (DE_EX.operation.is_bubble){
         if (!pipe.dcache->waiting) EX_MEM.operation = DE_EX.operation; 
-        if(prints) printf("In EXECUTE | BUBBLE\n");
+        TRACE(1, TRACE_EXEC, "In EXECUTE | BUBBLE\n");
         return;
     }
     Pipe_Op operation = DE_EX.operation; 
     uint8_t type = operation.type; 
-    uint16_t opcode = operation.opcode;
-    int64_t *regs = DE_EX.REGS;
-    uint64_t PC = DE_EX.PC; 
-    int FLAG_Z = DE_EX.FLAG_Z; 
-    int FLAG_N = DE_EX.FLAG_N; 
-    
-    if (type == CTYPE) {
-        int64_t COND_BR_address = operation.address;
-        int8_t Rt = operation.Rt;
-        switch(opcode) {
-            case 0x5A8 ... 0x5AF:  // CBNZ
-                if(regs[Rt] != 0) {
-                    PC = PC + COND_BR_address; 
-                    operation.will_jump = true;
-                } 
-                break; 
-            case 0x5A0 ... 0x5A7:  // CBZ
-                if(regs[Rt] == 0) {
-                    operation.will_jump = true;
-                    PC = PC + COND_BR_address; 
-                } 
-                break; 
-            case 0x2A0 ... 0x2A7:       // B.cond 
-                if (Rt == 0) { //BEQ
-                    if (FLAG_Z) {
-                        PC = PC + COND_BR_address; 
-                        operation.will_jump = true;
-                    } 
-                    break;
-                } else if (Rt == 1) { // BNE
-                    if (!FLAG_Z) {
-                        PC = (int64_t) (PC + COND_BR_address); 
-                        operation.will_jump = true;
-                    } 
-                    break;
-                } else if (Rt == 12) { // BGT
-                    if(!FLAG_N) {
-                        PC = (int64_t) (PC + COND_BR_address); 
-                        operation.will_jump = true;
-                    } 
-                    break;
-                } else if (Rt == 11) { // BLT 
-                    if(FLAG_N) {
-                        PC = (int64_t) (PC + COND_BR_address); 
-                        operation.will_jump = true;
-                    }
-                    break; 
-                } else if (Rt == 10) { // BGE 
-                    if(FLAG_Z || !FLAG_N) {
-                        PC = (int64_t) (PC + COND_BR_address); 
-                        operation.will_jump = true;
-                    } 
-                    break; 
-                } else if (Rt == 13) { // BLE 
-                    if(FLAG_Z || FLAG_N) {
-                        PC = (int64_t) (PC + COND_BR_address); 
-                        operation.will_jump = true;
-                    } 
-                    break; 
-                }
-                break;
-            default:
-                printf("ERROR: Unknown Instruction in CTYPE");
-                RUN_BIT = FALSE;
-        }
+    int64_t regs[ARM_REGS];
+    operands_spill(&DE_EX.operands, regs);
+    isa_state_t state = {
+        .regs = regs,
+        .FLAG_N = DE_EX.FLAG_N,
+        .FLAG_Z = DE_EX.FLAG_Z,
+        .PC = DE_EX.PC,
+    };
+
+    const isa_entry_t *entry = isa_lookup(operation.word);
+    if (entry->execute) {
+        entry->execute(&operation, &state);
     }
-    else if (type == ITYPE) {
 
-        uint16_t ALU_immediate = operation.immediate;
-        uint8_t Rn = operation.Rn;
-        uint8_t Rt = operation.Rt;
-        uint8_t shamt = ALU_immediate & 0x3F; // Extract bits [4:0] for shamt (5 bits).
-        int8_t shift = (ALU_immediate >> 6) & 0xFF; 
-        operation.mod_reg = true;
-
-
-        switch(opcode) {
-            case 0x488 ... 0x489:   // ADDI
-                regs[Rt] = regs[Rn] + ALU_immediate;
-                break; 
-            case 0x588 ... 0x589:   // ADDIS
-                regs[Rt] = regs[Rn] + ALU_immediate;
-                FLAG_Z = (regs[Rt] == 0);       
-                FLAG_N = (regs[Rt] < 0);
-                operation.flagSet = true; 
-                break; 
-            case 0x688 ... 0x689:    // SUBI
-                regs[Rt] = regs[Rn] - ALU_immediate;
-                break; 
-            case 0x788 ... 0x789:   // SUBIS
-                regs[Rt] = regs[Rn] - ALU_immediate;
-                FLAG_Z = (regs[Rt] == 0);
-                FLAG_N = (regs[Rt] < 0);
-                operation.flagSet = true; 
-                break; 
-            case 0x69A ... 0x69B:             // LSR
-                if (shamt == 0x3F) { // LSR
-                    regs[Rt] = regs[Rn] >> shift;  
-                    break;
-                } else { // LSL
-                    shift = ((-shift) % 64 + 64) % 64;
-                    regs[Rt] = regs[Rn] << shift; 
-                    break;
-                }
-            default: 
-                printf("ERROR: Unknown Instruction in ITYPE\n");
-        }
-    }
-    else if (type == RTYPE)
-    {
-        uint8_t Rt = operation.Rt;
-        uint8_t Rm = operation.Rm;
-        uint8_t Rn = operation.Rn;
-        uint8_t shamt = operation.misc;
-        switch (opcode)
-        {
-            case 0x458:             // ADD
-                regs[Rt] = regs[Rn] + regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x558:             // ADDS
-                regs[Rt] = regs[Rn] + regs[Rm];
-                FLAG_Z = (regs[Rt] == 0);
-                FLAG_N = (regs[Rt] < 0);
-                operation.flagSet = true; 
-                operation.mod_reg = true;
-                break;
-            case 0x450:             // AND     
-                regs[Rt] = regs[Rn] & regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x750:             // ANDS
-                regs[Rt] = regs[Rn] & regs[Rm];
-                FLAG_Z = (regs[Rt] == 0);
-                FLAG_N = (regs[Rt] < 0);
-                operation.flagSet = true; 
-                operation.mod_reg = true;
-                break;
-            case 0x650:             // EOR
-                regs[Rt] = regs[Rn] ^ regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x550:             // ORR
-                regs[Rt] = regs[Rn] | regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x658:             // SUB
-                regs[Rt] = regs[Rn] - regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x758:             // SUBS
-                regs[Rt] = regs[Rn] - regs[Rm];
-                FLAG_Z = (regs[Rt] == 0);
-                FLAG_N = (regs[Rt] < 0);
-                operation.flagSet = true; 
-                operation.mod_reg = true;
-                break;
-            case 0x4D8:             // MUL
-                regs[Rt] = regs[Rn] * regs[Rm];
-                operation.mod_reg = true;
-                break;
-            case 0x6B0:             // BR
-                PC = (uint64_t) regs[Rn]; 
-                operation.will_jump = true;
-                break;
-            default:
-                printf("ERROR: Uknown Instruction");
-                RUN_BIT = FALSE;
-        }
-    }
-    else if (type == IWTYPE)
-    {
-        uint8_t Rt = operation.Rt;
-        uint16_t immediate = operation.immediate; 
-        switch (opcode)
-        {
-            case 0x694 ... 0x697:   // MOVZ
-                if (prints2) printf("Moving immediate, %0X, to register rt, %d\n", immediate, Rt); 
-                regs[Rt] = immediate;
-                operation.mod_reg = true;
-                break;
-            case 0x6A2:             // HLT
-                HLT = TRUE; 
-                break;
-            default:
-                printf("ERROR: Uknown Instruction");
-                RUN_BIT = FALSE;
-        }
-    }
-    else if (type == BTYPE)
-    {
-        // Use *signed* 64-bit here too
-        int64_t branchOffset = operation.address;
-        switch (opcode)
-        {
-            case 0x0A0 ... 0x0BF:   // B
-                PC = PC + branchOffset;
-                operation.will_jump = true;
-                break;
-            default:
-                printf("ERROR: Unknown Instruction");
-                RUN_BIT = FALSE;
-        }
-    }
+    /* under a dcache wait this runs again once the wait is over, so
+     * the results stay out of DE/EX */
+    Pipe_Operands operands = DE_EX.operands;
+    operands_fill(&operands, regs);
+    uint64_t PC = state.PC; 
+    int FLAG_Z = state.FLAG_Z; 
+    int FLAG_N = state.FLAG_N; 
 
-    if(prints) printf("In EXECUTE | word: %0X\n", operation.word);
+    TRACE(1, TRACE_EXEC, "In EXECUTE | word: %0X\n", operation.word);
 
     if (!DE_EX.stalled){
         uint64_t target = PC;
         if (!operation.will_jump) target += 4;
 
-        bp_update(pipe.bp, DE_EX.PC, target, operation.will_jump, type == CTYPE);
+        bool is_branch = entry->flags & ISA_BRANCH;
+        bp_kind_t kind = !is_branch ? BP_NONE :
+                         type == CTYPE ? BP_COND :
+                         type == BTYPE ? BP_JUMP : BP_INDIRECT;
+        bp_update(pipe.bp, DE_EX.PC, target, operation.will_jump, kind);
+        if (is_branch) {
+            pipe.bp->branches++;
+            pipe.bp->cond_branches += kind == BP_COND;
+            pipe.bp->indirect_branches += kind == BP_INDIRECT;
+        }
 
 
         uint64_t prediction = IF_DE.PC;
-        if (IF_DE.sec_stall){
-            IF_DE.sec_stall = false;
-            prediction = pipe.PC;
-        }
+        IF_DE.sec_stall = false;
 
         if (!predicted(prediction, target) && PC != 0) {
+            TRACE(1, TRACE_BP, "BP         | %" PRIX64 " mispredicted, to %" PRIX64 "\n",
+                  DE_EX.PC, target);
+            if (is_branch) {
+                pipe.bp->mispredicts++;
+                pipe.bp->cond_mispredicts += kind == BP_COND;
+                pipe.bp->indirect_mispredicts += kind == BP_INDIRECT;
+            }
             flush_pipeline();
             if (pipe.icache->waiting){
                 if (!same_block(pipe.icache, IF_DE.PC, target)){
@@ -507,6 +770,7 @@ void pipe_stage_execute()
                 EX_MEM.flushed = false;
             }
             pipe.PC = target;
+            ftq_flush();
         }
     }
 
@@ -515,8 +779,8 @@ void pipe_stage_execute()
     if (pipe.dcache->waiting) return; 
 
     DE_EX.stalled = false;
-    memcpy(EX_MEM.REGS, regs, ARM_REGS * sizeof(int64_t));
-    EX_MEM.REGS[31] = 0;
+    EX_MEM.operands = operands;
+    operand_write(&EX_MEM.operands, 31, 0);
     EX_MEM.operation = operation; 
     EX_MEM.FLAG_N = FLAG_N; 
     EX_MEM.FLAG_Z = FLAG_Z; 
@@ -527,64 +791,94 @@ void pipe_stage_decode()
 {
     if (IF_DE.operation.is_bubble){
         if (!pipe.dcache->waiting) DE_EX.operation = IF_DE.operation; 
-        if(prints) printf("In DECODE  | BUBBLE\n");
+        TRACE(1, TRACE_DECODE, "In DECODE  | BUBBLE\n");
         return;
     }
 
-    uint16_t opcode;
-    ins_type type_tuple;
-    uint32_t type;
-    int op_len; 
     uint32_t word = IF_DE.operation.word;
+    Pipe_Op *cached = predecode_lookup(IF_DE.operation.PC);
 
-
-    for(int i = 0; i < TYPE_LIST_SIZE; i++) {
-        ins_type type_tuple = TYPE_LIST[i]; 
-        type = type_tuple.type; 
-        op_len = type_tuple.value;  
-        opcode = word >> (32 - op_len);
-        opcode = opcode << (11 - op_len);
-        bool status = find_operation(type, opcode, word); 
-        if (status) {
-            break; 
-        }
+    if (cached) {
+        uint32_t seq = IF_DE.operation.seq;
+        IF_DE.operation = *cached;
+        IF_DE.operation.seq = seq;
+    }
+    else {
+        isa_decode(word, &IF_DE.operation);
+        predecode_fill(IF_DE.operation.PC, &IF_DE.operation);
     }
     
-    if(prints) printf("In DECODE  | word: %0X, opcode: %0X\n", word, opcode);
+    TRACE(1, TRACE_DECODE, "In DECODE  | word: %0X, opcode: %0X\n", word, IF_DE.operation.opcode);
     if (pipe.dcache->waiting) return;
 
-    memcpy(DE_EX.REGS, pipe.REGS, ARM_REGS * sizeof(int64_t));
+    operands_load(&DE_EX.operands, &IF_DE.operation, pipe.REGS);
     DE_EX.PC = IF_DE.PC; 
     DE_EX.FLAG_N = pipe.FLAG_N;
     DE_EX.FLAG_Z = pipe.FLAG_Z;
     DE_EX.operation = IF_DE.operation;
 }
 
+Pipe_Op *predecode_lookup(uint64_t PC)
+{
+    uint64_t idx = (PC - MEM_TEXT_START) >> 2;
+    if (PC & 0x3 || idx >= PREDECODE_SIZE || !predecode_valid[idx])
+        return NULL;
+    return &predecode[idx];
+}
+
+void predecode_fill(uint64_t PC, const Pipe_Op *operation)
+{
+    uint64_t idx = (PC - MEM_TEXT_START) >> 2;
+    if (PC & 0x3 || idx >= PREDECODE_SIZE)
+        return;
+    predecode[idx] = *operation;
+    predecode_valid[idx] = true;
+}
+
+void predecode_invalidate(uint64_t address)
+{
+    /* an unaligned store can touch two words, the first of them
+     * possibly below the text */
+    if (!predecode_valid || address + 3 < MEM_TEXT_START)
+        return;
+    uint64_t first = address < MEM_TEXT_START ? 0 : (address - MEM_TEXT_START) >> 2;
+    uint64_t last = (address + 3 - MEM_TEXT_START) >> 2;
+    for (uint64_t idx = first; idx <= last && idx < PREDECODE_SIZE; idx++)
+        predecode_valid[idx] = false;
+}
+
 void forward_MEM_EX(Pipe_Op operation) {
-    if (operation.is_load && (operation.Rt == DE_EX.operation.Rn || operation.Rt == DE_EX.operation.Rm))
+    if (operation.is_load && (operation.Rt == DE_EX.operation.Rn || operation.Rt == DE_EX.operation.Rm ||
+                              (DE_EX.operation.is_store && operation.Rt == DE_EX.operation.Rt)))
     {
         STALL = true;
     }
     else if (operation.is_store && DE_EX.operation.is_load)
     {
-        uint64_t wr_addr = EX_MEM.REGS[operation.Rn] + operation.address;
-        uint64_t ld_addr = DE_EX.REGS[DE_EX.operation.Rn] + DE_EX.operation.address;
+        uint64_t wr_addr = operand_read(&EX_MEM.operands, operation.Rn) + operation.address;
+        uint64_t ld_addr = operand_read(&DE_EX.operands, DE_EX.operation.Rn) + DE_EX.operation.address;
         if (ld_addr > wr_addr - 4 && ld_addr < wr_addr + 4)
         {
             STALL = true;
         }
     }
+    forward_MEM_values(operation);
+}
+
+/* forward_MEM_EX without its stalls */
+static void forward_MEM_values(Pipe_Op operation)
+{
     if (operation.mod_reg && DE_EX.operation.is_store && operation.Rt == DE_EX.operation.Rt)
     {
-        DE_EX.REGS[DE_EX.operation.Rt] = EX_MEM.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rt, operand_read(&EX_MEM.operands, operation.Rt));
     }
     if (operation.mod_reg && operation.Rt == DE_EX.operation.Rn)
     {
-        DE_EX.REGS[DE_EX.operation.Rn] = EX_MEM.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rn, operand_read(&EX_MEM.operands, operation.Rt));
     }
     if (operation.mod_reg && operation.Rt == DE_EX.operation.Rm)
     {
-        DE_EX.REGS[DE_EX.operation.Rm] = EX_MEM.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rm, operand_read(&EX_MEM.operands, operation.Rt));
     }
     if (operation.flagSet)
     {
@@ -593,21 +887,20 @@ void forward_MEM_EX(Pipe_Op operation) {
     }
     if (DE_EX.operation.type == CTYPE) {
         if (operation.mod_reg && DE_EX.operation.Rt == operation.Rt) {
-            DE_EX.REGS[DE_EX.operation.Rt] = EX_MEM.REGS[operation.Rt]; 
+            operand_write(&DE_EX.operands, DE_EX.operation.Rt, operand_read(&EX_MEM.operands, operation.Rt)); 
         }
     }
-
 }
 
 void forward_WB_EX(Pipe_Op operation) {
 
     if (operation.mod_reg && operation.Rt == DE_EX.operation.Rn)
     {
-        DE_EX.REGS[DE_EX.operation.Rn] = MEM_WB.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rn, operand_read(&MEM_WB.operands, operation.Rt));
     }
     if (operation.mod_reg && operation.Rt == DE_EX.operation.Rm)
     {
-        DE_EX.REGS[DE_EX.operation.Rm] = MEM_WB.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rm, operand_read(&MEM_WB.operands, operation.Rt));
     }
     if (operation.flagSet)
     {
@@ -616,20 +909,30 @@ void forward_WB_EX(Pipe_Op operation) {
     }
     if (operation.mod_reg && DE_EX.operation.is_store && operation.Rt == DE_EX.operation.Rt)
     {
-        DE_EX.REGS[DE_EX.operation.Rt] = MEM_WB.REGS[operation.Rt];
+        operand_write(&DE_EX.operands, DE_EX.operation.Rt, operand_read(&MEM_WB.operands, operation.Rt));
+    }
+    if (DE_EX.operation.type == CTYPE) {
+        if (operation.mod_reg && DE_EX.operation.Rt == operation.Rt) {
+            operand_write(&DE_EX.operands, DE_EX.operation.Rt, operand_read(&MEM_WB.operands, operation.Rt)); 
+        }
     }
-    // if (DE_EX.operation.type == CTYPE) {
-    //     if (operation.mod_reg && DE_EX.operation.Rt == operation.Rt) {
-    //         DE_EX.REGS[DE_EX.operation.Rt] = MEM_WB.REGS[operation.Rt]; 
-    //     }
-    // }
 }
 
 void pipe_stage_fetch()
 {
+    if (draining) {
+        IF_DE.operation = initialize_operation();
+        IF_DE.operation.is_bubble = true;
+        return;
+    }
+    /* decode holds its instruction while the dcache waits, so the latch
+     * keeps that instruction's PC */
+    uint64_t held_PC = IF_DE.PC;
     if (IF_DE.stalled && !EX_MEM.stalled){
         IF_DE.PC = IF_DE.stalled_PC;
-        IF_DE.sec_stall = true;
+        /* incr_PC ran ahead while fetch was held, unless an icache
+         * miss held it too */
+        IF_DE.sec_stall = IF_DE.stalled_PC != pipe.PC;
         IF_DE.stalled = false;
     }
     else IF_DE.PC = pipe.PC; 
@@ -638,7 +941,7 @@ void pipe_stage_fetch()
         pipe.icache->cycles--;
         if (pipe.icache->cycles <= 0){
             pipe.icache->waiting = false;
-            cache_insert(pipe.icache, IF_DE.PC);
+            cache_complete(pipe.icache, IF_DE.PC);
         }
         else{
             IF_DE.operation.is_bubble = true;
@@ -646,152 +949,35 @@ void pipe_stage_fetch()
         }
     }
     if (EX_MEM.flushed){
+        pipe.bp->flush_cycles++;
         IF_DE.operation.is_bubble = true;
         return;
     }
 
-    if (cache_update(pipe.icache, IF_DE.PC) == 1){
+    int wait = cache_update(pipe.icache, IF_DE.PC, IF_DE.PC);
+    if (wait){
+        TRACE(1, TRACE_CACHE, "icache     | %" PRIX64 " waits %d\n", IF_DE.PC, wait);
         pipe.icache->waiting = true;
-        IF_DE.operation.is_bubble = true;
-        pipe.icache->cycles = 50;
-        return;
+        pipe.icache->cycles = wait;
+        /* the miss overlaps the dcache's, but the latch is decode's */
+        if (!pipe.dcache->waiting){
+            IF_DE.operation.is_bubble = true;
+            return;
+        }
     }
 
     if (pipe.dcache->waiting){
         IF_DE.stalled_PC = pipe.PC;
         IF_DE.stalled = true;
+        IF_DE.PC = held_PC;
         return;
     } 
 
     IF_DE.operation = initialize_operation(); 
     IF_DE.operation.word = mem_read_32(IF_DE.PC);
     IF_DE.operation.PC = IF_DE.PC; 
-    if(prints) printf("In Fetch   | word: %0X\n", IF_DE.operation.word);
-}
-
-bool find_operation(uint8_t type, uint16_t opcode, uint32_t word)
-{  
-    if (type == BTYPE)
-    {   
-        switch(opcode)
-        {
-            case 0x0A0 ... 0x0BF:   // B
-                break;
-            default:
-                return false; 
-        }
-        return decode_B(word, opcode); 
-    }
-    else if (type == CTYPE)
-    {
-        switch(opcode)
-        {
-            case 0x5A8 ... 0x5AF:   // CBNZ
-                break;
-            case 0x5A0 ... 0x5A7:   // CBZ
-                break;
-            case 0x2A0 ... 0x2A7:   // B.cond 
-                break;
-            default:
-                return false; 
-        }
-        return decode_CB(word, opcode);
-    }
-    else if (type == ITYPE)
-    {
-        switch(opcode)
-        {
-            case 0x488 ... 0x489:   // ADDI
-                break;
-            case 0x588 ... 0x589:   // ADDIS
-                break;
-            case 0x688 ... 0x689:   // SUBI
-                break;
-            case 0x788 ... 0x789:   // SUBIS 
-                break;
-            case 0x69A ... 0x69B:   // LSL or LSR
-                break;
-            default:
-                return false;
-        }
-        return decode_I(word, opcode);
-    }
-    else if (type == RTYPE)
-    {
-        switch(opcode)
-        {
-            case 0x458:             // ADD
-                break;
-            case 0x558:             // ADDS
-                break;
-            case 0x450:             // AND     
-                break;
-            case 0x750:             // ANDS
-                break;
-            case 0x650:             // EOR
-                break;
-            case 0x550:             // ORR
-                break;
-            case 0x658:             // SUB
-                break;
-            case 0x758:             // SUBS
-                break;
-            case 0x4D8:             // MUL
-                break;
-            case 0x6B0:             // BR
-                break;
-            default:
-                return false;
-        }
-        return decode_R(word, opcode);
-    }
-    else if (type == DTYPE)
-    {
-        switch(opcode)
-        {
-            case 0x7C2:             // LDUR
-                IF_DE.operation.is_load = true;
-                break;
-            case 0x5C2:             // LDUR (32-bit)
-                IF_DE.operation.is_load = true;
-                break;
-            case 0x1C2:             // LDURB
-                IF_DE.operation.is_load = true;
-                break;
-            case 0x3C2:             // LDURH
-                IF_DE.operation.is_load = true;
-                break;
-            case 0x7C0:             // STUR
-                IF_DE.operation.is_store = true;
-                break;
-            case 0x5C0:             // STUR (32-bit)
-                IF_DE.operation.is_store = true;
-                break;
-            case 0x1C0:             // STURB
-                IF_DE.operation.is_store = true;
-                break;
-            case 0x3C0:             // STURH
-                IF_DE.operation.is_store = true;
-                break;
-            default:
-                return false;
-        }
-        return decode_D(word, opcode);
-    }
-    else if (type == IWTYPE)
-    {
-        switch(opcode)
-        {
-            case 0x694 ... 0x697:   // MOVZ
-                break;
-            case 0x6a2:             // HLT
-                break;
-            default:
-                return false;
-        }
-        return decode_IW(word, opcode);
-    }
-    return false;
+    IF_DE.operation.seq = ++fetch_seq;
+    TRACE(1, TRACE_FETCH, "In Fetch   | word: %0X\n", IF_DE.operation.word);
 }
 
 Pipe_Op initialize_operation()
@@ -821,78 +1007,80 @@ void initialize_pipe_registers()
     memset(&MEM_WB, 0, sizeof(Pipe_Reg_MEMtoWB));
 }
 
-bool decode_R(uint32_t word, uint16_t opcode) {
-    /* Decoding helper function for R format words */
-    IF_DE.operation.opcode = opcode;
-    IF_DE.operation.type = RTYPE;
-    IF_DE.operation.Rm = (word >> 16) & 0x1F; 
-    IF_DE.operation.misc = (word >> 10) & 0x3F; 
-    IF_DE.operation.Rn = (word >> 5) & 0x1F; 
-    IF_DE.operation.Rt = word & 0x1F;
-    return true;
-}
-
-bool decode_D(uint32_t word, uint16_t opcode) {
-    /* Decoding helper function for D format words */
-    IF_DE.operation.opcode = opcode;
-    IF_DE.operation.type = DTYPE; 
-    IF_DE.operation.address = ((word >> 12) & 0x1FF);
-    IF_DE.operation.misc = (word >> 10) & 0x3;
-    IF_DE.operation.Rn = (word >> 5) & 0x1F;
-    IF_DE.operation.Rt = word & 0x1F;
-    return true;
-}
-
-bool decode_B(uint32_t word, uint16_t opcode) {
-
-    IF_DE.operation.opcode = opcode;
-    IF_DE.operation.type   = BTYPE;
-    int32_t imm26 = word & 0x03FFFFFF; 
-    if (imm26 & (1 << 25)) {
-        imm26 |= 0xFC000000;
-    }
-    imm26 <<= 2;
-    IF_DE.operation.address = imm26;
-    return true;
-}
-
-bool decode_CB(uint32_t word, uint16_t opcode) {
-    IF_DE.operation.opcode = opcode; 
-    IF_DE.operation.type = CTYPE;
-    int32_t imm19 = (word >> 5) & 0x7FFFF;
-    if (imm19 & (1 << 18)) {
-        imm19 |= 0xFFF80000;  // Set bits 31:19 to extend the sign
+void print_cache_stats(){
+    /* the shared levels once, with the last core to halt */
+    bool last = !core_others_running();
+    printf("\nCache statistics:\n");
+    cache_print_stats(pipe.icache, "L1I");
+    cache_print_stats(pipe.dcache, "L1D");
+    if (pipe.l2 && last) cache_print_stats(pipe.l2, "L2");
+    if (pipe.llc && last) cache_print_stats(pipe.llc, "LLC");
+    if (pipe.channel.writes && last) cache_print_channel(&pipe.channel);
+    if (ftq) {
+        printf("FTQ : %d entries  avg occupancy %.2f  redirect flushes %" PRIu64 "\n",
+               config.ftq, stat_cycles ? (double)ftq_occupancy / stat_cycles : 0.0,
+               ftq_flushes);
     }
-    imm19 <<= 2;
-    int64_t address = (int64_t) imm19;
-    IF_DE.operation.address = address;
-    IF_DE.operation.Rt = word & 0x1F;
-    return true;
-}
-
-bool decode_IW(uint32_t word, uint16_t opcode) {
-    /* Decoding helper function for IW format words */
-    IF_DE.operation.opcode = opcode;
-    IF_DE.operation.type = IWTYPE; 
-    IF_DE.operation.immediate = (word >> 5) & 0xFFFF; 
-    IF_DE.operation.Rt = word & 0x1F;
-    return true;
-}
-
-bool decode_I(uint32_t word, uint16_t opcode) {
-    /* Decoding helper function for I format words */
-    IF_DE.operation.opcode = opcode; 
-    IF_DE.operation.type = ITYPE; 
-    IF_DE.operation.immediate = (word >> 10) & 0xFFF; 
-    IF_DE.operation.Rn = (word >> 5) & 0x1F;
-    IF_DE.operation.Rt = word & 0x1F;
-    return true;
+    printf("\n");
 }
 
 void free_pipeline(){
+    bool last = !core_others_running();
+    trace_flush();
+    core_print_stats();
+    if (core == CORE_WIDE)
+        wide_print_stats();
+    if (core == CORE_OOO) {
+        ooo_print_stats();
+        ooo_free();
+    }
+    print_cache_stats();
+    bp_print_stats(pipe.bp);
     bp_free(pipe.bp);
     free(pipe.bp);
     pipe.bp = NULL;
+    if (pipe.dcache->bus)
+        coherence_detach(pipe.dcache);
     cache_destroy(pipe.icache);
     cache_destroy(pipe.dcache);
+    if (pipe.l2 && last) cache_destroy(pipe.l2);
+    if (pipe.llc && last) cache_destroy(pipe.llc);
+    pipe.l2 = pipe.llc = NULL;
+    free(ftq);
+    ftq = NULL;
+    if (last || config.parallel) {
+        free(predecode);
+        free(predecode_valid);
+        predecode = NULL;
+        predecode_valid = NULL;
+    }
+}
+
+void pipe_core_vars()
+{
+    CORE_VAR(pipe);
+    CORE_VAR(IF_DE);
+    CORE_VAR(DE_EX);
+    CORE_VAR(EX_MEM);
+    CORE_VAR(MEM_WB);
+    CORE_VAR(HLT);
+    CORE_VAR(STALL);
+    CORE_VAR(ftq);
+    CORE_VAR(ftq_head);
+    CORE_VAR(ftq_count);
+    CORE_VAR(ftq_flushes);
+    CORE_VAR(ftq_occupancy);
+    CORE_VAR(reg_ready);
+    CORE_VAR(draining);
+    CORE_VAR(committed);
+    CORE_VAR(committed_PC);
+    CORE_VAR(fetch_seq);
+    CORE_VAR(predecode);
+    CORE_VAR(predecode_valid);
+    if (core != CORE_SCALAR)
+        front_core_vars();
+    if (core == CORE_WIDE)
+        wide_core_vars();
+    if (core == CORE_OOO)
+        ooo_core_vars();
 }
\ No newline at end of file
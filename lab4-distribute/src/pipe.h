@@ -12,10 +12,20 @@
 
 #include "bp.h"
 #include "cache.h"
+#include "ckpt.h"
 #include "shell.h"
 #include "stdbool.h"
 #include <limits.h>
 
+/* instruction formats */
+#define RTYPE 6
+#define ITYPE 1
+#define DTYPE 2
+#define BTYPE 3
+#define CTYPE 4
+#define IWTYPE 5
+#define BUBBLE 10
+
 /* Represents an operation travelling through the pipeline. */
 typedef struct Pipe_Op {
 	uint8_t type; 
@@ -34,6 +44,7 @@ typedef struct Pipe_Op {
 	bool will_jump;
 	bool is_bubble; 
 	uint32_t PC; 
+	uint32_t seq;   /* fetch order, for the pipeline trace */
 } Pipe_Op;
 
 /* Represents the current state of the pipeline. */
@@ -52,6 +63,9 @@ typedef struct Pipe_State {
     bp_t *bp; 
     cache_t *icache;
     cache_t *dcache;
+    cache_t *l2;        /* unified, NULL if not configured */
+    cache_t *llc;
+    mem_channel_t channel;
 } Pipe_State;
 
 /* Represents the pipeline register between the IF and DE stage. */
@@ -64,10 +78,18 @@ typedef struct Pipe_Reg_IFtoDE {
 	bool is_bubble; 
 } Pipe_Reg_IFtoDE;
 
+/* Register values an instruction carries down the pipeline: the
+ * operands it reads and the result it writes, in slots for Rn, Rm
+ * and Rt. Slots naming the same register hold the same value. */
+typedef struct Pipe_Operands {
+	uint8_t reg[3];
+	int64_t val[3];
+} Pipe_Operands;
+
 /* Represents the pipeline register between the DE and EX stage. */
 typedef struct Pipe_Reg_DEtoEX {
 	Pipe_Op operation; 
-	int64_t REGS[ARM_REGS];
+	Pipe_Operands operands;
 	int FLAG_N;
 	int FLAG_Z;
 	uint64_t PC;
@@ -79,7 +101,7 @@ typedef struct Pipe_Reg_DEtoEX {
 /* Represents the pipeline register between the EX and MEM stage. */
 typedef struct Pipe_Reg_EXtoMEM {
 	Pipe_Op operation; 
-	int64_t REGS[ARM_REGS];
+	Pipe_Operands operands;
 	int FLAG_N;
 	int FLAG_Z;
 	uint64_t PC;
@@ -92,31 +114,25 @@ typedef struct Pipe_Reg_EXtoMEM {
 /* Represents the pipeline register between the MEM and WB stage. */
 typedef struct Pipe_Reg_MEMtoWB {
 	Pipe_Op operation; 
-	int64_t REGS[ARM_REGS];
+	Pipe_Operands operands;
 	int FLAG_N;
 	int FLAG_Z;
 	uint64_t PC;
 	bool is_bubble;
 } Pipe_Reg_MEMtoWB;
 
-/* Represents an instruction type as a tuple */
-typedef struct {
-	uint32_t type; // To hold the mask definition type
-	int value;     // To hold the associated integer value
-} ins_type;
-
-extern int RUN_BIT;
-extern int HLT;
-extern int STALL;
+extern __thread int RUN_BIT;
+extern __thread int HLT;
+extern __thread int STALL;
 
 /* global variable -- pipeline state */
-extern Pipe_State pipe;
+extern __thread Pipe_State pipe;
 
 /* global variables -- pipeline registers*/
-extern Pipe_Reg_IFtoDE IF_DE; 
-extern Pipe_Reg_DEtoEX DE_EX; 
-extern Pipe_Reg_EXtoMEM EX_MEM; 
-extern Pipe_Reg_MEMtoWB MEM_WB; 
+extern __thread Pipe_Reg_IFtoDE IF_DE; 
+extern __thread Pipe_Reg_DEtoEX DE_EX; 
+extern __thread Pipe_Reg_EXtoMEM EX_MEM; 
+extern __thread Pipe_Reg_MEMtoWB MEM_WB; 
 
 /* called during simulator startup */
 void pipe_init();
@@ -134,22 +150,57 @@ void pipe_stage_wb();
 /* Helper functions */
 Pipe_Op initialize_operation(); 
 void initialize_pipe_registers();
-bool find_operation(uint8_t type, uint16_t opcode, uint32_t word);
 void delay(int milliseconds); 
 
 
-bool decode_R(uint32_t word, uint16_t opcode); 
-bool decode_I(uint32_t word, uint16_t opcode); 
-bool decode_D(uint32_t word, uint16_t opcode);
-bool decode_B(uint32_t word, uint16_t opcode);
-bool decode_CB(uint32_t word, uint16_t opcode);
-bool decode_IW(uint32_t word, uint16_t opcode);
+/* predecoded operations, keyed by text address */
+Pipe_Op *predecode_lookup(uint64_t PC);
+void predecode_fill(uint64_t PC, const Pipe_Op *operation);
+void predecode_invalidate(uint64_t address);
 
 void incr_PC();
 void forward_WB_EX(Pipe_Op operation);
 void forward_MEM_EX(Pipe_Op operation);
 void flush_pipeline(); 
 void free_pipeline();
+void print_cache_stats();
+
+/* switching between timing and functional simulation */
+int pipe_drain();
+void pipe_restart();
+void pipe_clear_stats();
+
+/* statistics a measurement window reads at each end */
+typedef struct {
+	uint32_t cycles, insts;
+	uint64_t accesses[4], misses[4];	/* L1I, L1D, L2, LLC */
+	uint64_t branches, mispredicts;
+} pipe_counters_t;
+void pipe_read_counters(pipe_counters_t *c);
+/* time insts instructions in detail, reading the counters either side */
+void pipe_measure(uint32_t insts, pipe_counters_t *from, pipe_counters_t *to);
+
+/* all of the simulator's state but guest memory */
+void pipe_checkpoint(ckpt_t *ck);
+/* the per-core globals, see core.h */
+void pipe_core_vars();
+
+/* N-wide in-order model in pipe_wide.c, used when config.width > 1 */
+void wide_init();
+void wide_cycle();
+bool wide_idle();
+void wide_print_stats();
+void wide_checkpoint(ckpt_t *ck);
+void wide_core_vars();
+
+/* out-of-order model in ooo.c, used with -core=ooo */
+void ooo_init();
+void ooo_cycle();
+bool ooo_idle();
+void ooo_free();
+void ooo_print_stats();
+void ooo_checkpoint(ckpt_t *ck);
+void ooo_core_vars();
 
 
 #endif
\ No newline at end of file
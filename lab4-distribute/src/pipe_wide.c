@@ -0,0 +1,247 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * N-wide in-order pipeline, used when -width is above 1. Fetch brings
+ * up to width instructions from one icache block into a decode queue.
+ * Issue moves up to width of them into EX as a bundle, in order,
+ * stopping at the first one whose operands are not ready or that
+ * would need a dcache port the bundle has used up. The bundle then
+ * goes through MEM, which serves its memory operations at up to
+ * dcache_ports per cycle, and all of it writes back together.
+ *
+ * Instructions execute functionally when they issue, in program
+ * order, so wrong-path instructions never touch state; the stages
+ * after that only model time.
+ */
+
+#include "front.h"
+#include "config.h"
+#include "core.h"
+#include "shell.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+typedef struct {
+    bool valid;
+    int count;
+    fetch_slot_t slot[FRONT_MAX_WIDTH];
+} wide_bundle_t;
+
+static int width;
+
+static __thread wide_bundle_t EX, MEM, WB;
+static __thread int mem_next;               /* next slot of MEM to access the dcache */
+static __thread int mem_wait;               /* dcache miss cycles left for that slot */
+
+/* cycle a register (or the flags) can next be read by an issuing op */
+static __thread uint64_t ready_at[ARM_REGS + 1];
+
+/* statistics; the stall counts are cycles issue stopped short of
+ * width for that reason */
+static __thread uint64_t retired;
+static __thread uint64_t issue_hist[FRONT_MAX_WIDTH + 1];
+static __thread uint64_t stall_dependency, stall_port, stall_empty, stall_busy;
+
+void wide_init()
+{
+    width = config.width;
+    if (width < 1 || width > FRONT_MAX_WIDTH) {
+        printf("Error: pipeline width must be between 1 and %d\n", FRONT_MAX_WIDTH);
+        exit(-1);
+    }
+    if (config.dcache_ports < 1) {
+        printf("Error: the wide pipeline needs at least one dcache port\n");
+        exit(-1);
+    }
+    front_init();
+    memset(&EX, 0, sizeof(EX));
+    memset(&MEM, 0, sizeof(MEM));
+    memset(&WB, 0, sizeof(WB));
+    mem_next = mem_wait = 0;
+    memset(ready_at, 0, sizeof(ready_at));
+    retired = 0;
+    memset(issue_hist, 0, sizeof(issue_hist));
+    stall_dependency = stall_port = stall_empty = stall_busy = 0;
+}
+
+static bool operands_ready(const fetch_slot_t *s)
+{
+    uint8_t regs[2];
+    int count = slot_sources(s, regs);
+    for (int i = 0; i < count; i++) {
+        if (ready_at[regs[i]] > stat_cycles)
+            return false;
+    }
+    return true;
+}
+
+static void wide_issue()
+{
+    if (EX.valid) {
+        stall_busy++;
+        issue_hist[0]++;
+        return;
+    }
+    if (front_count() == 0) {
+        stall_empty++;
+        issue_hist[0]++;
+        return;
+    }
+
+    int ports = 0;
+    EX.count = 0;
+    while (EX.count < width && front_count() > 0 && !HLT) {
+        fetch_slot_t *s = front_peek();
+        if (!operands_ready(s)) {
+            stall_dependency++;
+            break;
+        }
+        if (s->operation.type == DTYPE && ports == config.dcache_ports) {
+            stall_port++;
+            break;
+        }
+        ports += s->operation.type == DTYPE;
+
+        fetch_slot_t *slot = &EX.slot[EX.count++];
+        *slot = *s;
+        front_pop();
+
+        uint64_t next = slot_execute(slot);
+        Pipe_Op *op = &slot->operation;
+
+        /* loads deliver at the end of MEM, everything else after EX */
+        uint64_t ready = stat_cycles + (op->is_load ? 2 : 1);
+        if (op->mod_reg && op->Rt != 31)
+            ready_at[op->Rt] = ready;
+        if (op->flagSet)
+            ready_at[FLAGS_REG] = ready;
+
+        bool mispredicted = slot_resolve(slot, next);
+        if (HLT) {
+            front_halt(slot);
+            break;
+        }
+        if (mispredicted) {
+            front_redirect(next);
+            break;
+        }
+    }
+    EX.valid = EX.count > 0;
+    issue_hist[EX.count]++;
+}
+
+/* serve MEM's memory operations; true once all of them are done */
+static bool wide_mem()
+{
+    if (mem_wait) {
+        if (--mem_wait > 0)
+            return false;
+        pipe.dcache->waiting = false;
+        cache_complete(pipe.dcache, MEM.slot[mem_next].address);
+        mem_next++;
+    }
+
+    int ports = 0;
+    for (; mem_next < MEM.count; mem_next++) {
+        fetch_slot_t *s = &MEM.slot[mem_next];
+        if (s->operation.type != DTYPE)
+            continue;
+        if (ports++ == config.dcache_ports)
+            return false;
+
+        int wait = s->operation.is_store ?
+                   cache_write(pipe.dcache, s->address, s->PC) :
+                   cache_update(pipe.dcache, s->address, s->PC);
+        if (wait) {
+            mem_wait = wait;
+            pipe.dcache->waiting = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+void wide_cycle()
+{
+    cache_tick(pipe.icache, stat_cycles);
+    cache_tick(pipe.dcache, stat_cycles);
+
+    if (WB.valid) {
+        for (int i = 0; i < WB.count; i++) {
+            stat_inst_retire++;
+            retired++;
+            if (WB.slot[i].operation.opcode == OPCODE_HLT)
+                RUN_BIT = FALSE;
+        }
+        WB.valid = false;
+    }
+    if (!RUN_BIT)
+        return;
+
+    if (MEM.valid && wide_mem()) {
+        WB = MEM;
+        MEM.valid = false;
+    }
+    if (EX.valid && !MEM.valid) {
+        MEM = EX;
+        EX.valid = false;
+        mem_next = 0;
+    }
+    wide_issue();
+    front_fetch(width);
+}
+
+bool wide_idle()
+{
+    return !EX.valid && !MEM.valid && !WB.valid && front_idle();
+}
+
+void wide_checkpoint(ckpt_t *ck)
+{
+    ckpt_section(ck, "wide");
+    ckpt_var(ck, EX);
+    ckpt_var(ck, MEM);
+    ckpt_var(ck, WB);
+    ckpt_var(ck, mem_next);
+    ckpt_var(ck, mem_wait);
+    ckpt_var(ck, ready_at);
+    ckpt_var(ck, retired);
+    ckpt_var(ck, issue_hist);
+    ckpt_var(ck, stall_dependency);
+    ckpt_var(ck, stall_port);
+    ckpt_var(ck, stall_empty);
+    ckpt_var(ck, stall_busy);
+}
+
+void wide_core_vars()
+{
+    CORE_VAR(EX);
+    CORE_VAR(MEM);
+    CORE_VAR(WB);
+    CORE_VAR(mem_next);
+    CORE_VAR(mem_wait);
+    CORE_VAR(ready_at);
+    CORE_VAR(retired);
+    CORE_VAR(issue_hist);
+    CORE_VAR(stall_dependency);
+    CORE_VAR(stall_port);
+    CORE_VAR(stall_empty);
+    CORE_VAR(stall_busy);
+}
+
+void wide_print_stats()
+{
+    uint64_t cycles = stat_cycles ? stat_cycles : 1;
+    printf("Wide pipeline: width %d, IPC %.3f, squashed %" PRIu64 "\n",
+           width, (double)retired / cycles, front_squashed());
+    printf("  issued per cycle:");
+    for (int i = 0; i <= width; i++)
+        printf(" %d:%" PRIu64, i, issue_hist[i]);
+    printf("\n  issue stalls: dependency %" PRIu64 "  dcache port %" PRIu64
+           "  empty %" PRIu64 "  EX busy %" PRIu64 "\n",
+           stall_dependency, stall_port, stall_empty, stall_busy);
+}
@@ -0,0 +1,55 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Binary pipeline trace, written by the scalar pipeline under
+ * -trace=pipe and read back by pipeview. The file is a header and
+ * then one record per cycle giving what each stage held, why the
+ * pipeline was held up and what happened in the caches and predictor.
+ * Everything is in host byte order.
+ */
+#ifndef _PIPETRACE_H_
+#define _PIPETRACE_H_
+
+#include <stdint.h>
+
+#define PIPE_TRACE_MAGIC        0x43525450u     /* "PTRC" */
+#define PIPE_TRACE_VERSION      1
+
+enum { PIPE_IF, PIPE_DE, PIPE_EX, PIPE_MEM, PIPE_WB, PIPE_STAGES };
+
+/* stall reasons */
+#define PIPE_STALL_ICACHE       (1u << 0)   /* fetch waits on the icache */
+#define PIPE_STALL_DCACHE       (1u << 1)   /* memory waits on the dcache */
+#define PIPE_STALL_DATA         (1u << 2)   /* load-use or store-load hazard */
+#define PIPE_STALL_MSHR         (1u << 3)   /* operand still being filled */
+#define PIPE_STALL_FLUSH        (1u << 4)   /* refetching after a redirect */
+
+/* events */
+#define PIPE_EVENT_ICACHE_MISS  (1u << 0)
+#define PIPE_EVENT_DCACHE_MISS  (1u << 1)
+#define PIPE_EVENT_MISPREDICT   (1u << 2)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stages;
+    uint32_t record_size;
+} pipe_trace_header_t;
+
+/* seq numbers instructions in fetch order from 1; 0 is an empty stage */
+typedef struct {
+    uint32_t seq;
+    uint32_t PC;
+    uint32_t word;
+} pipe_trace_slot_t;
+
+typedef struct {
+    uint64_t cycle;
+    uint16_t stall;
+    uint16_t events;
+    pipe_trace_slot_t stage[PIPE_STAGES];
+} pipe_trace_record_t;
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * pipeview: offline reader for the -trace=pipe files the simulator
+ * writes. It prints where the cycles went, and with -o3 converts the
+ * trace to gem5's O3PipeView text, which Konata and o3-pipeview.py
+ * display.
+ *
+ *     pipeview [-o3 file] [-ticks n] trace
+ */
+
+#include "pipetrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* instructions between the oldest unfinished one and the newest */
+#define WINDOW 4096
+
+typedef struct {
+    uint32_t seq;
+    uint32_t PC;
+    uint32_t word;
+    bool seen[PIPE_STAGES];
+    uint64_t at[PIPE_STAGES];   /* first cycle in each stage */
+} inst_t;
+
+static inst_t window[WINDOW];
+static uint32_t next_emit = 1;  /* oldest instruction not yet written out */
+static uint32_t last_seq;
+static FILE *o3;
+static uint64_t ticks = 1000;   /* per cycle */
+
+/* breakdown; each cycle that retires nothing is charged to the first
+ * reason that applies, in this order */
+static const struct {
+    uint16_t stall;
+    const char *name;
+} REASONS[] = {
+    { PIPE_STALL_DCACHE, "dcache" },
+    { PIPE_STALL_MSHR, "mshr fill" },
+    { PIPE_STALL_DATA, "data hazard" },
+    { PIPE_STALL_ICACHE, "icache" },
+    { PIPE_STALL_FLUSH, "flush" },
+};
+#define NUM_REASONS (sizeof(REASONS) / sizeof(REASONS[0]))
+
+static uint64_t cycles, retired, squashed;
+static uint64_t charged[NUM_REASONS + 1];   /* the last is "other" */
+static uint64_t stalled[NUM_REASONS];       /* any cycle with the reason */
+static uint64_t icache_misses, dcache_misses, mispredicts;
+
+static uint64_t tick(const inst_t *in, int stage)
+{
+    return in->seen[stage] ? in->at[stage] * ticks : 0;
+}
+
+static void emit(inst_t *in)
+{
+    bool done = in->seen[PIPE_WB];
+    squashed += !done;
+    if (o3 && in->seen[PIPE_IF]) {
+        bool store = ((in->word >> 21) & 0x1FF) == 0x1C0;  /* STUR{,B,H,W} */
+        fprintf(o3, "O3PipeView:fetch:%" PRIu64 ":0x%08" PRIx32 ":0:%" PRIu32
+                    ":.word 0x%08" PRIx32 "\n",
+                tick(in, PIPE_IF), in->PC, in->seq, in->word);
+        fprintf(o3, "O3PipeView:decode:%" PRIu64 "\n", tick(in, PIPE_DE));
+        fprintf(o3, "O3PipeView:rename:%" PRIu64 "\n", tick(in, PIPE_DE));
+        fprintf(o3, "O3PipeView:dispatch:%" PRIu64 "\n", tick(in, PIPE_DE));
+        fprintf(o3, "O3PipeView:issue:%" PRIu64 "\n", tick(in, PIPE_EX));
+        fprintf(o3, "O3PipeView:complete:%" PRIu64 "\n", tick(in, PIPE_MEM));
+        fprintf(o3, "O3PipeView:retire:%" PRIu64 ":store:%" PRIu64 "\n",
+                done ? tick(in, PIPE_WB) : 0,
+                done && store ? tick(in, PIPE_MEM) : 0);
+    }
+    in->seq = 0;
+}
+
+/* write out everything older than seq; the pipeline is in order, so
+ * whatever has not retired by now was squashed */
+static void emit_before(uint32_t seq)
+{
+    for (; next_emit < seq; next_emit++) {
+        inst_t *in = &window[next_emit % WINDOW];
+        if (in->seq == next_emit)
+            emit(in);
+    }
+}
+
+static void track(const pipe_trace_slot_t *slot, int stage, uint64_t cycle)
+{
+    if (slot->seq == 0 || slot->seq < next_emit)
+        return;
+    if (slot->seq - next_emit >= WINDOW)
+        emit_before(slot->seq - WINDOW + 1);
+
+    inst_t *in = &window[slot->seq % WINDOW];
+    if (slot->seq > last_seq)
+        last_seq = slot->seq;
+    if (in->seq != slot->seq) {
+        memset(in, 0, sizeof(*in));
+        in->seq = slot->seq;
+        in->PC = slot->PC;
+        in->word = slot->word;
+    }
+    if (!in->seen[stage]) {
+        in->seen[stage] = true;
+        in->at[stage] = cycle;
+    }
+    if (stage == PIPE_WB) {
+        retired++;
+        emit_before(slot->seq);
+        emit(in);
+        next_emit = slot->seq + 1;
+    }
+}
+
+static void account(const pipe_trace_record_t *r)
+{
+    cycles++;
+    icache_misses += (r->events & PIPE_EVENT_ICACHE_MISS) != 0;
+    dcache_misses += (r->events & PIPE_EVENT_DCACHE_MISS) != 0;
+    mispredicts += (r->events & PIPE_EVENT_MISPREDICT) != 0;
+
+    int reason = NUM_REASONS;
+    for (int i = NUM_REASONS - 1; i >= 0; i--) {
+        if (r->stall & REASONS[i].stall) {
+            stalled[i]++;
+            reason = i;
+        }
+    }
+    if (r->stage[PIPE_WB].seq == 0)
+        charged[reason]++;
+
+    for (int s = PIPE_IF; s < PIPE_STAGES; s++)
+        track(&r->stage[s], s, r->cycle);
+}
+
+static double percent(uint64_t n)
+{
+    return cycles ? 100.0 * n / cycles : 0;
+}
+
+static void print_breakdown()
+{
+    uint64_t busy = cycles;
+    printf("cycles %" PRIu64 "  retired %" PRIu64 "  IPC %.3f  squashed %" PRIu64 "\n",
+           cycles, retired, cycles ? (double)retired / cycles : 0, squashed);
+    printf("cycle breakdown:\n");
+    for (int i = 0; i <= NUM_REASONS; i++)
+        busy -= charged[i];
+    printf("  %-12s %12" PRIu64 "  %5.1f%%\n", "retiring", busy, percent(busy));
+    for (int i = 0; i < NUM_REASONS; i++)
+        printf("  %-12s %12" PRIu64 "  %5.1f%%\n", REASONS[i].name, charged[i],
+               percent(charged[i]));
+    printf("  %-12s %12" PRIu64 "  %5.1f%%\n", "other", charged[NUM_REASONS],
+           percent(charged[NUM_REASONS]));
+    printf("cycles stalled on (overlapping):\n");
+    for (int i = 0; i < NUM_REASONS; i++)
+        printf("  %-12s %12" PRIu64 "  %5.1f%%\n", REASONS[i].name, stalled[i],
+               percent(stalled[i]));
+    printf("events: icache misses %" PRIu64 "  dcache misses %" PRIu64
+           "  mispredicts %" PRIu64 "\n", icache_misses, dcache_misses, mispredicts);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-o3 file] [-ticks n] trace\n", name);
+    printf("  -o3 file   write O3PipeView text to file (- for stdout)\n");
+    printf("  -ticks n   O3PipeView ticks per cycle (default 1000)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *trace = NULL, *o3_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o3") == 0 && i + 1 < argc)
+            o3_path = argv[++i];
+        else if (strcmp(argv[i], "-ticks") == 0 && i + 1 < argc)
+            ticks = strtoull(argv[++i], NULL, 0);
+        else if (argv[i][0] != '-' && !trace)
+            trace = argv[i];
+        else
+            usage(argv[0]);
+    }
+    if (!trace)
+        usage(argv[0]);
+
+    FILE *in = fopen(trace, "rb");
+    if (!in) {
+        printf("Error: can't open %s\n", trace);
+        exit(-1);
+    }
+    pipe_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != PIPE_TRACE_MAGIC) {
+        printf("Error: %s is not a pipeline trace\n", trace);
+        exit(-1);
+    }
+    if (header.version != PIPE_TRACE_VERSION || header.stages != PIPE_STAGES ||
+        header.record_size != sizeof(pipe_trace_record_t)) {
+        printf("Error: %s is version %u, this pipeview reads version %u\n",
+               trace, header.version, PIPE_TRACE_VERSION);
+        exit(-1);
+    }
+
+    if (o3_path) {
+        o3 = strcmp(o3_path, "-") == 0 ? stdout : fopen(o3_path, "w");
+        if (!o3) {
+            printf("Error: can't open %s\n", o3_path);
+            exit(-1);
+        }
+    }
+
+    pipe_trace_record_t r;
+    while (fread(&r, sizeof(r), 1, in) == 1)
+        account(&r);
+    fclose(in);
+    emit_before(last_seq + 1);
+
+    if (o3 && o3 != stdout)
+        fclose(o3);
+    if (o3 != stdout)
+        print_breakdown();
+    return 0;
+}
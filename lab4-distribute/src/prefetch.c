@@ -0,0 +1,166 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "prefetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *PREFETCH_NAMES[] = {
+    [PREFETCH_NONE] = "none",
+    [PREFETCH_NEXT_LINE] = "next-line",
+    [PREFETCH_STRIDE] = "stride",
+    [PREFETCH_STREAM] = "stream",
+    [PREFETCH_FDIP] = "fdip",
+};
+#define NUM_PREFETCHERS (sizeof(PREFETCH_NAMES) / sizeof(PREFETCH_NAMES[0]))
+
+int prefetch_parse(const char *name)
+{
+    for (int i = 0; i < NUM_PREFETCHERS; i++) {
+        if (strcmp(name, PREFETCH_NAMES[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *prefetch_name(prefetch_kind_t kind)
+{
+    return PREFETCH_NAMES[kind];
+}
+
+prefetcher_t *prefetch_new(prefetch_kind_t kind, int degree, int block_bits)
+{
+    if (degree < 1 || degree > PREFETCH_MAX_DEGREE) {
+        printf("Error: prefetch degree must be between 1 and %d\n", PREFETCH_MAX_DEGREE);
+        exit(-1);
+    }
+    prefetcher_t *p = calloc(1, sizeof(prefetcher_t));
+    p->kind = kind;
+    p->degree = degree;
+    p->block_bits = block_bits;
+    return p;
+}
+
+void prefetch_destroy(prefetcher_t *p)
+{
+    free(p);
+}
+
+static int train_next_line(prefetcher_t *p, uint64_t addr, bool trigger, uint64_t *out)
+{
+    if (!trigger)
+        return 0;
+    uint64_t block = addr >> p->block_bits;
+    for (int i = 0; i < p->degree; i++)
+        out[i] = (block + 1 + i) << p->block_bits;
+    return p->degree;
+}
+
+/* Every access trains its PC's entry; once the same stride has been
+ * seen twice in a row the next degree strides are proposed. */
+static int train_stride(prefetcher_t *p, uint64_t addr, uint64_t pc, uint64_t *out)
+{
+    rpt_entry_t *e = &p->rpt[(pc >> 2) & (RPT_SIZE - 1)];
+    if (e->pc != pc) {
+        e->pc = pc;
+        e->last_addr = addr;
+        e->stride = 0;
+        e->confidence = 0;
+        return 0;
+    }
+
+    int64_t stride = addr - e->last_addr;
+    e->last_addr = addr;
+    if (stride == e->stride) {
+        if (e->confidence < 3)
+            e->confidence++;
+    }
+    else {
+        if (e->confidence > 0)
+            e->confidence--;
+        if (e->confidence < 2)
+            e->stride = stride;
+    }
+    if (e->confidence < 2 || e->stride == 0)
+        return 0;
+
+    int count = 0;
+    for (int i = 1; i <= p->degree; i++) {
+        uint64_t target = addr + e->stride * i;
+        /* small strides land in the same block several times */
+        if (count && (target >> p->block_bits) == (out[count - 1] >> p->block_bits))
+            continue;
+        if ((target >> p->block_bits) == (addr >> p->block_bits))
+            continue;
+        out[count++] = target;
+    }
+    return count;
+}
+
+/* Misses close to a tracked stream extend it; two in the same
+ * direction confirm it and the blocks ahead of it are proposed. */
+static int train_stream(prefetcher_t *p, uint64_t addr, bool trigger, uint64_t *out)
+{
+    if (!trigger)
+        return 0;
+
+    uint64_t block = addr >> p->block_bits;
+    stream_entry_t *victim = &p->streams[0];
+    p->stream_clock++;
+
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        stream_entry_t *s = &p->streams[i];
+        if (!s->valid) {
+            if (victim->valid)
+                victim = s;
+            continue;
+        }
+        if (victim->valid && s->lru < victim->lru)
+            victim = s;
+
+        int64_t delta = block - s->last_block;
+        if (delta == 0 || delta > STREAM_WINDOW || delta < -STREAM_WINDOW)
+            continue;
+
+        int dir = delta > 0 ? 1 : -1;
+        if (dir == s->dir) {
+            if (s->confidence < 3)
+                s->confidence++;
+        }
+        else {
+            s->dir = dir;
+            s->confidence = 1;
+        }
+        s->last_block = block;
+        s->lru = p->stream_clock;
+        if (s->confidence < 2)
+            return 0;
+        for (int j = 0; j < p->degree; j++)
+            out[j] = (block + s->dir * (j + 1)) << p->block_bits;
+        return p->degree;
+    }
+
+    victim->valid = true;
+    victim->last_block = block;
+    victim->dir = 0;
+    victim->confidence = 0;
+    victim->lru = p->stream_clock;
+    return 0;
+}
+
+int prefetch_train(prefetcher_t *p, uint64_t addr, uint64_t pc, bool trigger,
+                   uint64_t *out)
+{
+    switch (p->kind) {
+        case PREFETCH_NEXT_LINE: return train_next_line(p, addr, trigger, out);
+        case PREFETCH_STRIDE:    return train_stride(p, addr, pc, out);
+        case PREFETCH_STREAM:    return train_stream(p, addr, trigger, out);
+        case PREFETCH_FDIP:
+        case PREFETCH_NONE:      break;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Hardware prefetchers. A prefetcher only watches demand accesses and
+ * proposes block addresses; the cache decides which of them to fetch
+ * and keeps the issued/useful/late counts.
+ */
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include <stdint.h>
+#include "stdbool.h"
+
+#define PREFETCH_MAX_DEGREE 8
+#define RPT_SIZE            64      /* stride: entries, indexed by PC */
+#define STREAM_COUNT        8       /* stream: tracked streams */
+#define STREAM_WINDOW       4       /* blocks a miss may be from a stream */
+
+typedef enum {
+    PREFETCH_NONE,
+    PREFETCH_NEXT_LINE,     /* the blocks after a miss */
+    PREFETCH_STRIDE,        /* per-PC reference prediction table */
+    PREFETCH_STREAM,        /* ascending or descending miss streams */
+    PREFETCH_FDIP,          /* driven by the fetch target queue, trains on nothing */
+} prefetch_kind_t;
+
+typedef struct {
+    uint64_t pc;
+    uint64_t last_addr;
+    int64_t stride;
+    int confidence;         /* 2-bit, prefetch from 2 up */
+} rpt_entry_t;
+
+typedef struct {
+    bool valid;
+    uint64_t last_block;
+    int dir;                /* +1 or -1, 0 until a second miss */
+    int confidence;
+    uint64_t lru;
+} stream_entry_t;
+
+typedef struct {
+    prefetch_kind_t kind;
+    int degree;             /* blocks proposed per trigger */
+    int block_bits;
+
+    rpt_entry_t rpt[RPT_SIZE];
+    stream_entry_t streams[STREAM_COUNT];
+    uint64_t stream_clock;
+
+    uint64_t issued;        /* prefetches sent to the next level */
+    uint64_t useful;        /* prefetched blocks later hit by a demand access */
+    uint64_t late;          /* demand misses on a prefetch still in flight */
+} prefetcher_t;
+
+/* -1 if name is not a prefetcher */
+int prefetch_parse(const char *name);
+const char *prefetch_name(prefetch_kind_t kind);
+
+prefetcher_t *prefetch_new(prefetch_kind_t kind, int degree, int block_bits);
+void prefetch_destroy(prefetcher_t *p);
+
+/* Train on a demand access. trigger is set for a miss or the first hit
+ * on a prefetched block. Candidate addresses go into out, which holds
+ * PREFETCH_MAX_DEGREE entries, and their number is returned. */
+int prefetch_train(prefetcher_t *p, uint64_t addr, uint64_t pc, bool trigger,
+                   uint64_t *out);
+
+#endif
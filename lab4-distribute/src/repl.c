@@ -0,0 +1,252 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "repl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RRPV_MAX        3
+#define RRPV_LONG       2
+#define BRRIP_EPSILON   32      /* BRRIP inserts long once every 32 fills */
+#define PSEL_MAX        1023
+#define DUEL_PERIOD     32      /* one leader set of each kind per 32 sets */
+
+static const char *REPL_NAMES[] = {
+    [REPL_LRU] = "lru",
+    [REPL_TREE_PLRU] = "tree-plru",
+    [REPL_BIT_PLRU] = "bit-plru",
+    [REPL_RANDOM] = "random",
+    [REPL_SRRIP] = "srrip",
+    [REPL_DRRIP] = "drrip",
+};
+#define NUM_POLICIES (sizeof(REPL_NAMES) / sizeof(REPL_NAMES[0]))
+
+int repl_parse(const char *name)
+{
+    for (int i = 0; i < NUM_POLICIES; i++) {
+        if (strcmp(name, REPL_NAMES[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *repl_name(repl_policy_t policy)
+{
+    return REPL_NAMES[policy];
+}
+
+static inline uint64_t *set_state(repl_t *r, int set)
+{
+    return &r->state[(uint64_t)set * r->words];
+}
+
+/* fields are 1, 2 or 8 bits wide, so they never straddle a word */
+static inline int get_field(repl_t *r, uint64_t *s, int way)
+{
+    int pos = way * r->bits;
+    return (s[pos >> 6] >> (pos & 63)) & ((1ULL << r->bits) - 1);
+}
+
+static inline void set_field(repl_t *r, uint64_t *s, int way, int value)
+{
+    int pos = way * r->bits;
+    uint64_t mask = ((1ULL << r->bits) - 1) << (pos & 63);
+    s[pos >> 6] = (s[pos >> 6] & ~mask) | ((uint64_t)value << (pos & 63));
+}
+
+static int log2_ways(int ways)
+{
+    int levels = 0;
+    while ((1 << levels) < ways)
+        levels++;
+    return levels;
+}
+
+repl_t *repl_new(repl_policy_t policy, int sets, int ways)
+{
+    repl_t *r = calloc(1, sizeof(repl_t));
+    r->policy = policy;
+    r->ways = ways;
+    r->rng = 0x2545F491;
+    r->psel = (PSEL_MAX + 1) / 2;
+
+    if (ways > 64) {
+        printf("Error: %s replacement supports at most 64 ways\n", repl_name(policy));
+        exit(-1);
+    }
+
+    switch (policy) {
+        case REPL_LRU:       r->bits = 8; break;
+        case REPL_BIT_PLRU:  r->bits = 1; break;
+        case REPL_SRRIP:
+        case REPL_DRRIP:     r->bits = 2; break;
+        case REPL_TREE_PLRU:
+            if ((1 << log2_ways(ways)) != ways) {
+                printf("Error: tree-plru replacement needs a power-of-two associativity\n");
+                exit(-1);
+            }
+            r->bits = 1;
+            break;
+        case REPL_RANDOM:    r->bits = 0; break;
+    }
+    r->words = (ways * r->bits + 63) / 64;
+    r->state = calloc((uint64_t)sets * (r->words ? r->words : 1), sizeof(uint64_t));
+
+    for (int set = 0; set < sets; set++) {
+        uint64_t *s = set_state(r, set);
+        for (int way = 0; way < ways; way++) {
+            if (policy == REPL_LRU)
+                set_field(r, s, way, way);
+            else if (policy == REPL_SRRIP || policy == REPL_DRRIP)
+                set_field(r, s, way, RRPV_MAX);
+        }
+    }
+    return r;
+}
+
+void repl_destroy(repl_t *r)
+{
+    free(r->state);
+    free(r);
+}
+
+void repl_checkpoint(repl_t *r, int sets, ckpt_t *ck)
+{
+    ckpt_var(ck, r->rng);
+    ckpt_var(ck, r->psel);
+    ckpt_blob(ck, r->state, (uint64_t)sets * (r->words ? r->words : 1) * sizeof(uint64_t));
+}
+
+static uint32_t repl_rand(repl_t *r)
+{
+    r->rng ^= r->rng << 13;
+    r->rng ^= r->rng >> 17;
+    r->rng ^= r->rng << 5;
+    return r->rng;
+}
+
+static void lru_touch(repl_t *r, uint64_t *s, int way)
+{
+    int rank = get_field(r, s, way);
+    for (int i = 0; i < r->ways; i++) {
+        int other = get_field(r, s, i);
+        if (other < rank)
+            set_field(r, s, i, other + 1);
+    }
+    set_field(r, s, way, 0);
+}
+
+/* each tree node bit points at the half the next victim comes from */
+static void tree_touch(repl_t *r, uint64_t *s, int way)
+{
+    int node = 1;
+    for (int level = log2_ways(r->ways) - 1; level >= 0; level--) {
+        int dir = (way >> level) & 1;
+        if (dir)
+            s[0] &= ~(1ULL << (node - 1));
+        else
+            s[0] |= 1ULL << (node - 1);
+        node = node * 2 + dir;
+    }
+}
+
+static void bit_touch(repl_t *r, uint64_t *s, int way)
+{
+    uint64_t all = r->ways == 64 ? ~0ULL : (1ULL << r->ways) - 1;
+    s[0] |= 1ULL << way;
+    if ((s[0] & all) == all)
+        s[0] = 1ULL << way;
+}
+
+/* DRRIP leader sets: 0 = follower, 1 = SRRIP leader, 2 = BRRIP leader */
+static int duel_role(int set)
+{
+    int slot = set % DUEL_PERIOD;
+    return slot == 0 ? 1 : slot == 1 ? 2 : 0;
+}
+
+void repl_hit(repl_t *r, int set, int way)
+{
+    uint64_t *s = set_state(r, set);
+    switch (r->policy) {
+        case REPL_LRU:       lru_touch(r, s, way); break;
+        case REPL_TREE_PLRU: tree_touch(r, s, way); break;
+        case REPL_BIT_PLRU:  bit_touch(r, s, way); break;
+        case REPL_SRRIP:
+        case REPL_DRRIP:     set_field(r, s, way, 0); break;
+        case REPL_RANDOM:    break;
+    }
+}
+
+void repl_fill(repl_t *r, int set, int way)
+{
+    uint64_t *s = set_state(r, set);
+    switch (r->policy) {
+        case REPL_SRRIP:
+            set_field(r, s, way, RRPV_LONG);
+            break;
+        case REPL_DRRIP: {
+            int role = duel_role(set);
+            if (role == 1 && r->psel < PSEL_MAX)
+                r->psel++;
+            else if (role == 2 && r->psel > 0)
+                r->psel--;
+
+            int brrip = role == 2 || (role == 0 && r->psel > PSEL_MAX / 2);
+            if (brrip && repl_rand(r) % BRRIP_EPSILON)
+                set_field(r, s, way, RRPV_MAX);
+            else
+                set_field(r, s, way, RRPV_LONG);
+            break;
+        }
+        default:
+            repl_hit(r, set, way);
+    }
+}
+
+int repl_victim(repl_t *r, int set)
+{
+    uint64_t *s = set_state(r, set);
+    switch (r->policy) {
+        case REPL_LRU: {
+            int victim = 0;
+            for (int i = 1; i < r->ways; i++) {
+                if (get_field(r, s, i) > get_field(r, s, victim))
+                    victim = i;
+            }
+            return victim;
+        }
+        case REPL_TREE_PLRU: {
+            int node = 1, way = 0;
+            for (int level = log2_ways(r->ways) - 1; level >= 0; level--) {
+                int dir = (s[0] >> (node - 1)) & 1;
+                way = (way << 1) | dir;
+                node = node * 2 + dir;
+            }
+            return way;
+        }
+        case REPL_BIT_PLRU:
+            for (int i = 0; i < r->ways; i++) {
+                if (!(s[0] & (1ULL << i)))
+                    return i;
+            }
+            return 0;
+        case REPL_RANDOM:
+            return repl_rand(r) % r->ways;
+        case REPL_SRRIP:
+        case REPL_DRRIP:
+            for (;;) {
+                for (int i = 0; i < r->ways; i++) {
+                    if (get_field(r, s, i) == RRPV_MAX)
+                        return i;
+                }
+                for (int i = 0; i < r->ways; i++)
+                    set_field(r, s, i, get_field(r, s, i) + 1);
+            }
+    }
+    return 0;
+}
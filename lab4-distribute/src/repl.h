@@ -0,0 +1,45 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Cache replacement policies. Each set keeps its replacement state in
+ * a few packed 64-bit words instead of a timestamp per block.
+ */
+#ifndef _REPL_H_
+#define _REPL_H_
+
+#include <stdint.h>
+#include "ckpt.h"
+
+typedef enum {
+    REPL_LRU,           /* true LRU, 8-bit recency rank per way */
+    REPL_TREE_PLRU,     /* binary tree, ways - 1 bits per set */
+    REPL_BIT_PLRU,      /* one MRU bit per way */
+    REPL_RANDOM,
+    REPL_SRRIP,         /* 2-bit re-reference prediction per way */
+    REPL_DRRIP,         /* SRRIP/BRRIP chosen by set dueling */
+} repl_policy_t;
+
+typedef struct {
+    repl_policy_t policy;
+    int ways;
+    int bits;           /* state bits per way, tree-PLRU uses one word */
+    int words;          /* state words per set */
+    uint64_t *state;
+    uint32_t rng;
+    int psel;           /* DRRIP policy selector */
+} repl_t;
+
+/* -1 if name is not a policy */
+int repl_parse(const char *name);
+const char *repl_name(repl_policy_t policy);
+
+repl_t *repl_new(repl_policy_t policy, int sets, int ways);
+void repl_destroy(repl_t *r);
+void repl_hit(repl_t *r, int set, int way);
+void repl_fill(repl_t *r, int set, int way);
+int repl_victim(repl_t *r, int set);
+void repl_checkpoint(repl_t *r, int sets, ckpt_t *ck);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "sample.h"
+#include "config.h"
+#include "func.h"
+#include "pipe.h"
+#include <math.h>
+#include <stdio.h>
+
+/* 99.7% of a normal distribution, the confidence SMARTS reports */
+#define SAMPLE_Z        3.0
+#define SAMPLE_ERROR    0.03    /* target for the suggested sample count */
+
+static uint64_t total;
+static uint32_t last_retired;
+
+static void advance()
+{
+    total += (uint32_t)(stat_inst_retire - last_retired);
+    last_retired = stat_inst_retire;
+}
+
+void sample_run()
+{
+    uint64_t period = config.sample_period, warmup = config.sample_warmup;
+    uint64_t size = config.sample_size;
+    if (size == 0 || warmup + size > period || period >= (1u << 30)) {
+        printf("Error: sampling needs 0 < sample_warmup + sample_size <= sample_period < 1G\n\n");
+        return;
+    }
+
+    /* per-instruction rates, summed over the samples; CPI's variance
+     * is kept with Welford's method */
+    static const char *LEVELS[] = { "L1I", "L1D", "L2", "LLC" };
+    double mean = 0, m2 = 0;
+    double accesses[4] = { 0 }, misses[4] = { 0 };
+    double branches = 0, mispredicts = 0;
+    uint64_t detailed = 0;
+    int samples = 0;
+
+    total = 0;
+    last_retired = stat_inst_retire;
+    while (RUN_BIT) {
+        pipe_drain();
+        advance();
+        if (!RUN_BIT)
+            break;
+        func_run(period - warmup - size, true);
+        advance();
+        pipe_restart();
+        if (HLT) {
+            RUN_BIT = FALSE;
+            free_pipeline();
+            break;
+        }
+
+        pipe_counters_t from, to;
+        pipe_measure(warmup, &from, &to);
+        detailed += (uint32_t)(to.insts - from.insts);
+        if (!RUN_BIT)
+            break;
+        pipe_measure(size, &from, &to);
+        advance();
+        double n = (uint32_t)(to.insts - from.insts);
+        detailed += n;
+        /* a sample cut short by HLT is not like the others */
+        if (n < size)
+            break;
+
+        double cpi = (uint32_t)(to.cycles - from.cycles) / n;
+        double delta = cpi - mean;
+        samples++;
+        mean += delta / samples;
+        m2 += delta * (cpi - mean);
+        for (int l = 0; l < 4; l++) {
+            accesses[l] += (to.accesses[l] - from.accesses[l]) / n;
+            misses[l] += (to.misses[l] - from.misses[l]) / n;
+        }
+        branches += (to.branches - from.branches) / n;
+        mispredicts += (to.mispredicts - from.mispredicts) / n;
+    }
+    advance();
+
+    printf("\nSMARTS estimate for %" PRIu64 " instructions from %d samples of %" PRIu64
+           " (%" PRIu64 " simulated in detail):\n", total, samples, size, detailed);
+    if (!samples) {
+        printf("  no complete samples; lower sample_period\n\n");
+        return;
+    }
+    printf("  CPI %.3f", mean);
+    if (samples > 1) {
+        double sd = sqrt(m2 / (samples - 1));
+        double half = SAMPLE_Z * sd / sqrt(samples);
+        double cv = mean ? sd / mean : 0;
+        printf(" +- %.3f (%.2f%%, 99.7%% confidence)  cycles %.0f +- %.0f\n",
+               half, mean ? 100 * half / mean : 0.0, mean * total, half * total);
+        printf("  CPI coefficient of variation %.3f; +-%.0f%% needs %.0f samples\n",
+               cv, 100 * SAMPLE_ERROR, ceil(pow(SAMPLE_Z * cv / SAMPLE_ERROR, 2)));
+    } else {
+        printf("  cycles %.0f (one sample, no confidence interval)\n", mean * total);
+    }
+    for (int l = 0; l < 4; l++) {
+        if (!accesses[l])
+            continue;
+        printf("  %-4s misses %.0f of %.0f accesses (%.2f%%)\n", LEVELS[l],
+               misses[l] / samples * total, accesses[l] / samples * total,
+               100 * misses[l] / accesses[l]);
+    }
+    printf("  branches %.0f  mispredicted %.0f (%.2f%%)\n\n", branches / samples * total,
+           mispredicts / samples * total, branches ? 100 * mispredicts / branches : 0.0);
+}
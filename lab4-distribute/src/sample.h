@@ -0,0 +1,18 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * SMARTS sampling: the program runs functionally, warming the caches
+ * and predictor as it goes, and every sample_period instructions the
+ * pipeline times sample_warmup instructions to fill itself and then
+ * measures sample_size more. The samples' CPI gives the whole run's
+ * with a confidence interval.
+ */
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+
+/* sample from pipe.PC until HLT and print the estimate */
+void sample_run();
+
+#endif
@@ -20,89 +20,22 @@
 
 #include "shell.h"
 #include "pipe.h"
+#include "mem.h"
+#include "config.h"
+#include "core.h"
+#include "func.h"
+#include "trace.h"
+#include "ckpt.h"
+#include "simpoint.h"
+#include "sample.h"
+#include "parallel.h"
 
 /***************************************************************/
 /* Statistics.                                                 */
 /***************************************************************/
 
-uint32_t stat_cycles = 0, stat_inst_retire = 0, stat_inst_fetch = 0;
-uint32_t stat_squash = 0;
-
-/***************************************************************/
-/* Main memory.                                                */
-/***************************************************************/
-
-#define MEM_DATA_START  0x10000000
-#define MEM_DATA_SIZE   0x00100000
-#define MEM_TEXT_START  0x00400000
-#define MEM_TEXT_SIZE   0x00100000
-#define MEM_STACK_START 0xfffffffc
-#define MEM_STACK_SIZE  0x00100000
-
-typedef struct {
-    uint64_t start, size;
-    uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-    { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
-    { MEM_DATA_START, MEM_DATA_SIZE, NULL },
-    { MEM_STACK_START, MEM_STACK_SIZE, NULL },
-};
-#define MEM_NREGIONS (sizeof(MEM_REGIONS)/sizeof(mem_region_t))
-
-
-
-/***************************************************************/
-/*                                                             */
-/* Procedure: mem_read_32                                      */
-/*                                                             */
-/* Purpose: Read a 32-bit word from memory                     */
-/*                                                             */
-/***************************************************************/
-uint32_t mem_read_32(uint64_t address)
-{
-    int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            return
-                (MEM_REGIONS[i].mem[offset+3] << 24) |
-                (MEM_REGIONS[i].mem[offset+2] << 16) |
-                (MEM_REGIONS[i].mem[offset+1] <<  8) |
-                (MEM_REGIONS[i].mem[offset+0] <<  0);
-        }
-    }
-
-    return 0;
-}
-
-/***************************************************************/
-/*                                                             */
-/* Procedure: mem_write_32                                     */
-/*                                                             */
-/* Purpose: Write a 32-bit word to memory                      */
-/*                                                             */
-/***************************************************************/
-void mem_write_32(uint64_t address, uint32_t value)
-{
-    int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-            MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-            MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-            MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
-            return;
-        }
-    }
-}
+__thread uint32_t stat_cycles = 0, stat_inst_retire = 0, stat_inst_fetch = 0;
+__thread uint32_t stat_squash = 0;
 
 /***************************************************************/
 /*                                                             */
@@ -115,6 +48,18 @@ void help() {
   printf("----------------ARM ISIM Help-----------------------\n");
   printf("go                     -  run program to completion         \n");
   printf("run n                  -  execute program for n instructions\n");
+  printf("fastforward n          -  execute n instructions functionally\n");
+  printf("warmup n               -  same, warming caches and predictor;\n");
+  printf("                          statistics restart afterwards     \n");
+  printf("profile n file         -  run to the end functionally and   \n");
+  printf("                          write SimPoints for n-instruction  \n");
+  printf("                          intervals to file                 \n");
+  printf("simpoint file          -  simulate those points in detail   \n");
+  printf("                          and estimate the whole run        \n");
+  printf("sample                 -  run to the end with SMARTS        \n");
+  printf("                          sampling and estimate CPI         \n");
+  printf("checkpoint file        -  save the whole simulator to file  \n");
+  printf("restore file           -  continue from a saved checkpoint  \n");
   printf("mdump low high         -  dump memory from low to high      \n");
   printf("rdump                  -  dump the register & bus values    \n");
   printf("input reg_no reg_value - set GPR reg_no to reg_value  \n");
@@ -130,7 +75,7 @@ void help() {
 /*                                                             */
 /***************************************************************/
 void cycle() {                                                
-  pipe_cycle();
+  core_cycle();
 
   stat_cycles++;
 }
@@ -151,13 +96,20 @@ void run(int num_cycles) {
   }
 
   printf("Simulating for %d cycles...\n\n", num_cycles);
+  if (config.parallel && config.cores > 1) {
+    if (parallel_run(num_cycles) < num_cycles)
+      printf("Simulator halted\n\n");
+    return;
+  }
   for (i = 0; i < num_cycles; i++) {
     if (!RUN_BIT) {
+	    trace_flush();
 	    printf("Simulator halted\n\n");
 	    break;
     }
     cycle();
   }
+  trace_flush();
 }
 
 /***************************************************************/
@@ -174,10 +126,125 @@ void go() {
   }
 
   printf("Simulating...\n\n");
+  if (config.parallel && config.cores > 1)
+    parallel_run(UINT64_MAX);
   while (RUN_BIT)
     cycle();
+  trace_flush();
+  printf("Simulator halted\n\n");
+}
+/***************************************************************/
+/*                                                             */
+/* Procedure : one_core                                        */
+/*                                                             */
+/* Purpose   : The commands that switch to functional          */
+/*             simulation or save state drive a single core    */
+/*                                                             */
+/***************************************************************/
+int one_core(const char *command) {
+  if (config.cores == 1)
+    return TRUE;
+  printf("Can't %s with more than one core\n\n", command);
+  return FALSE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : fastforward n                                   */
+/*                                                             */
+/* Purpose   : Drain the pipeline, execute n instructions      */
+/*             without timing, and resume timing from there    */
+/*                                                             */
+/***************************************************************/
+void fastforward(uint64_t count, bool warm) {
+  uint64_t ran;
+  int drained;
+
+  if (!one_core(warm ? "warm up" : "fast-forward"))
+    return;
+
+  if (!RUN_BIT) {
+    printf("Can't simulate, Simulator is halted\n\n");
+    return;
+  }
+
+  drained = pipe_drain();
+  if (!RUN_BIT) {
+    printf("Simulator halted\n\n");
+    return;
+  }
+  ran = func_run(count, warm);
+  pipe_restart();
+  if (warm)
+    pipe_clear_stats();
+  printf("%s %" PRIu64 " instructions (%d cycles to drain)\n\n",
+         warm ? "Warmed up on" : "Fast-forwarded", ran, drained);
+  if (HLT) {
+    RUN_BIT = FALSE;
+    free_pipeline();
+    printf("Simulator halted\n\n");
+  }
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : profile n file / simpoint file                  */
+/*                                                             */
+/* Purpose   : Find a program's phases in a functional run,    */
+/*             then time one interval of each in detail. Both  */
+/*             start from the beginning of the program         */
+/*                                                             */
+/***************************************************************/
+void profile(uint64_t interval, const char *path) {
+  if (!one_core("profile"))
+    return;
+  if (!RUN_BIT) {
+    printf("Can't profile, Simulator is halted\n\n");
+    return;
+  }
+
+  pipe_drain();
+  if (!RUN_BIT) {
+    printf("Simulator halted\n\n");
+    return;
+  }
+  if (simpoint_profile(interval, path) == 0) {
+    pipe_restart();
+    return;
+  }
+  RUN_BIT = FALSE;
+  free_pipeline();
   printf("Simulator halted\n\n");
 }
+
+void simpoint(const char *path) {
+  if (!one_core("simulate points"))
+    return;
+  if (!RUN_BIT) {
+    printf("Can't simulate, Simulator is halted\n\n");
+    return;
+  }
+  simpoint_run(path);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : sample                                          */
+/*                                                             */
+/* Purpose   : Finish the program functionally, timing a short */
+/*             window every sample_period instructions         */
+/*                                                             */
+/***************************************************************/
+void sample() {
+  if (!one_core("sample"))
+    return;
+  if (!RUN_BIT) {
+    printf("Can't simulate, Simulator is halted\n\n");
+    return;
+  }
+  sample_run();
+}
+
 /***************************************************************/ 
 /*                                                             */
 /* Procedure : mdump                                           */
@@ -212,17 +279,22 @@ void mdump(FILE * dumpsim_file, int start, int stop) {
 /*                                                             */
 /***************************************************************/
 void rdump(FILE * dumpsim_file) {                               
-  int k; 
+  int k, c; 
 
   printf("\nCurrent register/bus values :\n");
   printf("-------------------------------------\n");
   printf("Instruction Retired : %u\n", stat_inst_retire);
-  printf("PC                : 0x%" PRIx64 "\n", pipe.PC);
-  printf("Registers:\n");
-  for (k = 0; k < ARM_REGS; k++)
-    printf("X%d: 0x%" PRIx64 "\n", k, pipe.REGS[k]);
-  printf("FLAG_N: %d\n", pipe.FLAG_N);
-  printf("FLAG_Z: %d\n", pipe.FLAG_Z);
+  for (c = 0; c < config.cores; c++) {
+    core_switch(c);
+    if (config.cores > 1)
+      printf("Core %d:\n", c);
+    printf("PC                : 0x%" PRIx64 "\n", pipe.PC);
+    printf("Registers:\n");
+    for (k = 0; k < ARM_REGS; k++)
+      printf("X%d: 0x%" PRIx64 "\n", k, pipe.REGS[k]);
+    printf("FLAG_N: %d\n", pipe.FLAG_N);
+    printf("FLAG_Z: %d\n", pipe.FLAG_Z);
+  }
   printf("No. of Cycles: %d\n", stat_cycles);
   printf("\n");
 
@@ -230,16 +302,52 @@ void rdump(FILE * dumpsim_file) {
   fprintf(dumpsim_file, "\nCurrent register/bus values :\n");
   fprintf(dumpsim_file, "-------------------------------------\n");
   fprintf(dumpsim_file, "Instruction Retired : %u\n", stat_inst_retire);
-  fprintf(dumpsim_file, "PC                : 0x%" PRIx64 "\n", pipe.PC);
-  fprintf(dumpsim_file, "Registers:\n");
-  for (k = 0; k < ARM_REGS; k++)
-    fprintf(dumpsim_file, "X%d: 0x%" PRIx64 "\n", k, pipe.REGS[k]);
-  fprintf(dumpsim_file, "FLAG_N: %d\n", pipe.FLAG_N);
-  fprintf(dumpsim_file, "FLAG_Z: %d\n", pipe.FLAG_Z);
+  for (c = 0; c < config.cores; c++) {
+    core_switch(c);
+    if (config.cores > 1)
+      fprintf(dumpsim_file, "Core %d:\n", c);
+    fprintf(dumpsim_file, "PC                : 0x%" PRIx64 "\n", pipe.PC);
+    fprintf(dumpsim_file, "Registers:\n");
+    for (k = 0; k < ARM_REGS; k++)
+      fprintf(dumpsim_file, "X%d: 0x%" PRIx64 "\n", k, pipe.REGS[k]);
+    fprintf(dumpsim_file, "FLAG_N: %d\n", pipe.FLAG_N);
+    fprintf(dumpsim_file, "FLAG_Z: %d\n", pipe.FLAG_Z);
+  }
   fprintf(dumpsim_file, "No. of Cycles: %d\n", stat_cycles);
   fprintf(dumpsim_file, "\n");
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : checkpoint file / restore file                  */
+/*                                                             */
+/* Purpose   : Save the simulator's state, or pick it up again */
+/*             from a checkpoint taken with the same options   */
+/*                                                             */
+/***************************************************************/
+void checkpoint(const char *path) {
+  if (!one_core("checkpoint"))
+    return;
+  if (!RUN_BIT) {
+    printf("Can't checkpoint, Simulator is halted\n\n");
+    return;
+  }
+  if (ckpt_save(path) == 0)
+    printf("Checkpoint at cycle %u written to %s\n\n", stat_cycles, path);
+}
+
+void restore(const char *path) {
+  if (!one_core("restore"))
+    return;
+  /* halting frees the pipeline; restore into a fresh simulator */
+  if (!RUN_BIT) {
+    printf("Can't restore, Simulator is halted\n\n");
+    return;
+  }
+  if (ckpt_restore(path) == 0)
+    printf("Restored %s at cycle %u\n\n", path, stat_cycles);
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : get_command                                     */
@@ -249,7 +357,9 @@ void rdump(FILE * dumpsim_file) {
 /***************************************************************/
 void get_command(FILE * dumpsim_file) {                         
   char buffer[20];
+  char path[256];
   int start, stop, cycles;
+  uint64_t count;
   int register_no;
   int64_t register_value;
 
@@ -283,16 +393,54 @@ void get_command(FILE * dumpsim_file) {
     printf("Bye.\n");
     exit(0);
 
+  case 'C':
+  case 'c':
+    if (scanf("%255s", path) != 1) break;
+    checkpoint(path);
+    break;
+
   case 'R':
   case 'r':
     if (buffer[1] == 'd' || buffer[1] == 'D')
 	    rdump(dumpsim_file);
+    else if (buffer[1] == 'e' || buffer[1] == 'E') {
+	    if (scanf("%255s", path) != 1) break;
+	    restore(path);
+    }
     else {
 	    if (scanf("%d", &cycles) != 1) break;
 	    run(cycles);
     }
     break;
 
+  case 'F':
+  case 'f':
+    if (scanf("%" SCNu64, &count) != 1) break;
+    fastforward(count, false);
+    break;
+
+  case 'W':
+  case 'w':
+    if (scanf("%" SCNu64, &count) != 1) break;
+    fastforward(count, true);
+    break;
+
+  case 'P':
+  case 'p':
+    if (scanf("%" SCNu64 " %255s", &count, path) != 2) break;
+    profile(count, path);
+    break;
+
+  case 'S':
+  case 's':
+    if (buffer[1] == 'a' || buffer[1] == 'A')
+	    sample();
+    else {
+	    if (scanf("%255s", path) != 1) break;
+	    simpoint(path);
+    }
+    break;
+
   case 'I':
   case 'i':
    if (scanf("%i %" PRIx64, &register_no, &register_value) != 2)
@@ -314,11 +462,7 @@ void get_command(FILE * dumpsim_file) {
 /*                                                             */
 /***************************************************************/
 void init_memory() {                                           
-    int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size);
-        memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
-    }
+    mem_init();
 }
 
 /**************************************************************/
@@ -375,6 +519,7 @@ void initialize(char *program_filename, int num_prog_files) {
   }
     
   RUN_BIT = 1;
+  core_init();
 }
 
 /***************************************************************/
@@ -385,10 +530,13 @@ void initialize(char *program_filename, int num_prog_files) {
 int main(int argc, char *argv[]) {                              
   FILE * dumpsim_file;
 
+  argc = config_parse(argc, argv);
+
   /* Error Checking */
   if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
+    printf("Error: usage: %s [-option=value ...] <program_file_1> <program_file_2> ...\n",
            argv[0]);
+    config_usage();
     exit(1);
   }
 
@@ -20,11 +20,19 @@
 
 #define ARM_REGS 32
 
+/* guest memory layout */
+#define MEM_DATA_START  0x10000000
+#define MEM_DATA_SIZE   0x00100000
+#define MEM_TEXT_START  0x00400000
+#define MEM_TEXT_SIZE   0x00100000
+#define MEM_STACK_START 0xfffffffc
+#define MEM_STACK_SIZE  0x00100000
+
 /* only the cache touches these functions */
 uint32_t mem_read_32(uint64_t address);
 void     mem_write_32(uint64_t address, uint32_t value);
 
 /* statistics */
-extern uint32_t stat_cycles, stat_inst_retire, stat_inst_fetch, stat_squash;
+extern __thread uint32_t stat_cycles, stat_inst_retire, stat_inst_fetch, stat_squash;
 
 #endif
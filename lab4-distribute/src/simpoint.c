@@ -0,0 +1,504 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "simpoint.h"
+#include "config.h"
+#include "front.h"
+#include "func.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* basic blocks by the address of their first instruction; id is one
+ * more than the block's index, 0 for an empty slot */
+typedef struct {
+    uint64_t PC;
+    uint32_t id;
+} block_slot_t;
+
+static block_slot_t *blocks;
+static uint32_t block_mask;
+static uint32_t num_blocks, block_capacity;
+static uint64_t *block_count;   /* instructions in the current interval */
+static double *block_row;       /* the block's column of the projection */
+static uint32_t *touched;       /* blocks with a count this interval */
+static uint32_t num_touched;
+
+/* one projected, normalised vector per interval */
+static double *vectors;
+static uint64_t *lengths;
+static int num_intervals, interval_capacity;
+static int dims;
+
+static uint64_t rng;
+
+static uint64_t rng_next()
+{
+    uint64_t z = (rng += 0x9E3779B97F4A7C15ULL);    /* splitmix64 */
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_uniform()
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t block_hash(uint64_t PC)
+{
+    return (uint32_t)(((PC >> 2) * 0x9E3779B97F4A7C15ULL) >> 32) & block_mask;
+}
+
+static void blocks_grow()
+{
+    block_slot_t *old = blocks;
+    uint32_t old_size = old ? block_mask + 1 : 0;
+
+    block_capacity = block_capacity ? 2 * block_capacity : 1024;
+    block_mask = 2 * block_capacity - 1;
+    blocks = calloc(block_mask + 1, sizeof(*blocks));
+    block_count = realloc(block_count, block_capacity * sizeof(*block_count));
+    block_row = realloc(block_row, (size_t)block_capacity * dims * sizeof(*block_row));
+    touched = realloc(touched, block_capacity * sizeof(*touched));
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (!old[i].id)
+            continue;
+        uint32_t h = block_hash(old[i].PC);
+        while (blocks[h].id)
+            h = (h + 1) & block_mask;
+        blocks[h] = old[i];
+    }
+    free(old);
+}
+
+/* A random projection keeps the vectors short however many blocks the
+ * program has; each block gets a column of uniform [-1, 1) values. */
+static uint32_t block_find(uint64_t PC)
+{
+    uint32_t h = block_hash(PC);
+    while (blocks[h].id && blocks[h].PC != PC)
+        h = (h + 1) & block_mask;
+    if (blocks[h].id)
+        return blocks[h].id - 1;
+
+    if (num_blocks == block_capacity) {
+        blocks_grow();
+        return block_find(PC);
+    }
+    uint32_t id = num_blocks++;
+    blocks[h].PC = PC;
+    blocks[h].id = id + 1;
+    block_count[id] = 0;
+    for (int d = 0; d < dims; d++)
+        block_row[(size_t)id * dims + d] = 2 * rng_uniform() - 1;
+    return id;
+}
+
+static void block_add(uint64_t PC, uint64_t count)
+{
+    uint32_t id = block_find(PC);
+    if (!block_count[id])
+        touched[num_touched++] = id;
+    block_count[id] += count;
+}
+
+static void interval_end(uint64_t length)
+{
+    if (num_intervals == interval_capacity) {
+        interval_capacity = interval_capacity ? 2 * interval_capacity : 256;
+        vectors = realloc(vectors, (size_t)interval_capacity * dims * sizeof(*vectors));
+        lengths = realloc(lengths, interval_capacity * sizeof(*lengths));
+    }
+    double *v = &vectors[(size_t)num_intervals * dims];
+    memset(v, 0, dims * sizeof(*v));
+    for (uint32_t i = 0; i < num_touched; i++) {
+        uint32_t id = touched[i];
+        double share = (double)block_count[id] / length;
+        const double *row = &block_row[(size_t)id * dims];
+        for (int d = 0; d < dims; d++)
+            v[d] += share * row[d];
+        block_count[id] = 0;
+    }
+    num_touched = 0;
+    lengths[num_intervals++] = length;
+}
+
+static void profile_free()
+{
+    free(blocks);
+    free(block_count);
+    free(block_row);
+    free(touched);
+    free(vectors);
+    free(lengths);
+    blocks = NULL;
+    block_count = NULL;
+    block_row = NULL;
+    touched = NULL;
+    vectors = NULL;
+    lengths = NULL;
+    num_blocks = block_capacity = block_mask = num_touched = 0;
+    num_intervals = interval_capacity = 0;
+}
+
+static double distance(const double *a, const double *b)
+{
+    double sum = 0;
+    for (int d = 0; d < dims; d++)
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+/* Lloyd's algorithm from a k-means++ start. Returns the summed squared
+ * distance of the intervals to their centres. */
+static double kmeans(int k, double *centers, int *assign)
+{
+    int R = num_intervals;
+    double *nearest = malloc(R * sizeof(*nearest));
+    int *size = malloc(k * sizeof(*size));
+    double sse = 0;
+
+    memcpy(centers, &vectors[(rng_next() % R) * dims], dims * sizeof(*centers));
+    for (int i = 0; i < R; i++)
+        nearest[i] = distance(&vectors[(size_t)i * dims], centers);
+    for (int c = 1; c < k; c++) {
+        double total = 0;
+        for (int i = 0; i < R; i++)
+            total += nearest[i];
+        double pick = rng_uniform() * total;
+        int chosen = R - 1;
+        for (int i = 0; i < R; i++) {
+            pick -= nearest[i];
+            if (pick < 0) {
+                chosen = i;
+                break;
+            }
+        }
+        double *center = &centers[(size_t)c * dims];
+        memcpy(center, &vectors[(size_t)chosen * dims], dims * sizeof(*center));
+        for (int i = 0; i < R; i++) {
+            double dist = distance(&vectors[(size_t)i * dims], center);
+            if (dist < nearest[i])
+                nearest[i] = dist;
+        }
+    }
+
+    for (int i = 0; i < R; i++)
+        assign[i] = -1;
+    for (int iter = 0; iter < 100; iter++) {
+        bool changed = false;
+        sse = 0;
+        for (int i = 0; i < R; i++) {
+            const double *v = &vectors[(size_t)i * dims];
+            int best = 0;
+            double best_dist = distance(v, centers);
+            for (int c = 1; c < k; c++) {
+                double dist = distance(v, &centers[(size_t)c * dims]);
+                if (dist < best_dist) {
+                    best = c;
+                    best_dist = dist;
+                }
+            }
+            changed |= assign[i] != best;
+            assign[i] = best;
+            nearest[i] = best_dist;
+            sse += best_dist;
+        }
+        if (!changed)
+            break;
+
+        memset(centers, 0, (size_t)k * dims * sizeof(*centers));
+        memset(size, 0, k * sizeof(*size));
+        for (int i = 0; i < R; i++) {
+            size[assign[i]]++;
+            for (int d = 0; d < dims; d++)
+                centers[(size_t)assign[i] * dims + d] += vectors[(size_t)i * dims + d];
+        }
+        for (int c = 0; c < k; c++) {
+            double *center = &centers[(size_t)c * dims];
+            if (size[c]) {
+                for (int d = 0; d < dims; d++)
+                    center[d] /= size[c];
+                continue;
+            }
+            /* an empty cluster takes the interval worst served */
+            int far = 0;
+            for (int i = 1; i < R; i++) {
+                if (nearest[i] > nearest[far])
+                    far = i;
+            }
+            memcpy(center, &vectors[(size_t)far * dims], dims * sizeof(*center));
+            nearest[far] = 0;
+        }
+    }
+    free(nearest);
+    free(size);
+    return sse;
+}
+
+/* Bayesian information criterion of a clustering, as X-means and
+ * SimPoint score it: the likelihood under spherical Gaussians less a
+ * penalty for the k * (dims + 1) parameters. */
+static double bic(int k, const int *assign, double sse)
+{
+    int R = num_intervals;
+    int *size = calloc(k, sizeof(*size));
+    double variance = sse / ((double)dims * (R > k ? R - k : 1));
+    double likelihood = 0;
+
+    if (variance < 1e-12)
+        variance = 1e-12;
+    for (int i = 0; i < R; i++)
+        size[assign[i]]++;
+    for (int c = 0; c < k; c++) {
+        double n = size[c];
+        if (!n)
+            continue;
+        likelihood += -n / 2 * log(2 * M_PI) - n * dims / 2 * log(variance)
+                      - (n - k) / 2 + n * log(n) - n * log(R);
+    }
+    free(size);
+    return likelihood - k * (dims + 1) / 2.0 * log(R);
+}
+
+typedef struct {
+    uint64_t interval;
+    double weight;
+} simpoint_t;
+
+static int point_order(const void *a, const void *b)
+{
+    const simpoint_t *x = a, *y = b;
+    return x->interval < y->interval ? -1 : x->interval > y->interval;
+}
+
+uint64_t simpoint_profile(uint64_t interval, const char *path)
+{
+    if (interval == 0 || config.simpoint_dims < 1 || config.simpoint_maxk < 1) {
+        printf("Error: simpoint needs a non-zero interval, simpoint_dims and simpoint_maxk\n");
+        return 0;
+    }
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        printf("Error: can't open %s\n", path);
+        return 0;
+    }
+    dims = config.simpoint_dims;
+    rng = config.simpoint_seed;
+    blocks_grow();
+
+    /* blocks end at every control transfer; an interval boundary splits
+     * a block between the two intervals */
+    fetch_slot_t s;
+    uint64_t ran = 0, in_interval = 0, in_block = 0;
+    uint64_t leader = pipe.PC;
+    while (!HLT) {
+        slot_decode(&s, pipe.PC);
+        uint64_t next = slot_execute(&s);
+        ran++;
+        in_block++;
+        if (slot_kind(&s) != BP_NONE) {
+            block_add(leader, in_block);
+            in_block = 0;
+            leader = next;
+        }
+        pipe.PC = HLT ? s.PC + 4 : next;
+        if (++in_interval == interval || HLT) {
+            if (in_block)
+                block_add(leader, in_block);
+            in_block = 0;
+            interval_end(in_interval);
+            in_interval = 0;
+        }
+    }
+    stat_inst_retire += ran;
+
+    /* the smallest k that scores within 90% of the best BIC */
+    int R = num_intervals;
+    int max_k = config.simpoint_maxk < R ? config.simpoint_maxk : R;
+    int *assign = malloc((size_t)max_k * R * sizeof(*assign));
+    double *centers = malloc((size_t)max_k * max_k * dims * sizeof(*centers));
+    double *score = malloc(max_k * sizeof(*score));
+    double lo = INFINITY, hi = -INFINITY;
+    for (int k = 1; k <= max_k; k++) {
+        int *a = &assign[(size_t)(k - 1) * R];
+        double sse = kmeans(k, &centers[(size_t)(k - 1) * max_k * dims], a);
+        score[k - 1] = bic(k, a, sse);
+        lo = fmin(lo, score[k - 1]);
+        hi = fmax(hi, score[k - 1]);
+    }
+    int k = 1;
+    while (k < max_k && score[k - 1] < lo + 0.9 * (hi - lo))
+        k++;
+    int *a = &assign[(size_t)(k - 1) * R];
+    double *c = &centers[(size_t)(k - 1) * max_k * dims];
+
+    /* each phase is represented by the interval nearest its centre and
+     * weighted by its share of the instructions */
+    simpoint_t *points = calloc(k, sizeof(*points));
+    double *best = malloc(k * sizeof(*best));
+    int phases = 0;
+    for (int j = 0; j < k; j++)
+        best[j] = INFINITY;
+    for (int i = 0; i < R; i++) {
+        double dist = distance(&vectors[(size_t)i * dims], &c[(size_t)a[i] * dims]);
+        points[a[i]].weight += (double)lengths[i] / ran;
+        if (dist < best[a[i]]) {
+            phases += best[a[i]] == INFINITY;
+            best[a[i]] = dist;
+            points[a[i]].interval = i;
+        }
+    }
+    /* empty clusters sort to the end with no weight */
+    for (int j = 0; j < k; j++) {
+        if (best[j] == INFINITY)
+            points[j].interval = UINT64_MAX;
+    }
+    qsort(points, k, sizeof(*points), point_order);
+
+    fprintf(out, "# simpoint interval %" PRIu64 " instructions %" PRIu64 " intervals %d\n",
+            interval, ran, R);
+    for (int j = 0; j < phases; j++)
+        fprintf(out, "%" PRIu64 " %.9f\n", points[j].interval, points[j].weight);
+    fclose(out);
+
+    printf("Profiled %" PRIu64 " instructions in %d intervals of %" PRIu64 " (%u blocks)\n",
+           ran, R, interval, num_blocks);
+    printf("%d phases, simulation points written to %s\n\n", phases, path);
+
+    free(points);
+    free(best);
+    free(score);
+    free(centers);
+    free(assign);
+    profile_free();
+    return ran;
+}
+
+/* ---- simulating the points ---- */
+
+static uint64_t position;       /* instructions since the driver started */
+static uint32_t last_retired;
+
+static void advance()
+{
+    position += (uint32_t)(stat_inst_retire - last_retired);
+    last_retired = stat_inst_retire;
+}
+
+/* func_run in pieces that the 32-bit retire count can't lose */
+static void skip_to(uint64_t target, bool warm)
+{
+    while (position < target && !HLT) {
+        uint64_t count = target - position;
+        func_run(count < (1u << 30) ? count : (1u << 30), warm);
+        advance();
+    }
+}
+
+static void halt()
+{
+    RUN_BIT = FALSE;
+    free_pipeline();
+    printf("Simulator halted\n\n");
+}
+
+void simpoint_run(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    uint64_t interval, total;
+    int num_intervals;
+    if (!in) {
+        printf("Error: can't open %s\n", path);
+        return;
+    }
+    if (fscanf(in, "# simpoint interval %" SCNu64 " instructions %" SCNu64 " intervals %d",
+               &interval, &total, &num_intervals) != 3 || interval == 0) {
+        printf("Error: %s is not a simpoint file\n", path);
+        fclose(in);
+        return;
+    }
+    simpoint_t *points = NULL;
+    int num_points = 0;
+    simpoint_t p;
+    while (fscanf(in, "%" SCNu64 " %lf", &p.interval, &p.weight) == 2) {
+        points = realloc(points, (num_points + 1) * sizeof(*points));
+        points[num_points++] = p;
+    }
+    fclose(in);
+    qsort(points, num_points, sizeof(*points), point_order);
+
+    /* per-instruction rates, weighted by phase */
+    double weight = 0, cpi = 0, branches = 0, mispredicts = 0;
+    double accesses[4] = { 0 }, misses[4] = { 0 };
+    uint64_t detailed = 0;
+    int simulated = 0;
+
+    position = 0;
+    last_retired = stat_inst_retire;
+    for (int i = 0; i < num_points && RUN_BIT; i++) {
+        uint64_t start = points[i].interval * interval;
+        uint64_t length = start + interval <= total ? interval : total - start;
+
+        pipe_drain();
+        advance();
+        if (!RUN_BIT)
+            break;
+        if (start < position)
+            start = position;
+        skip_to(start > config.simpoint_warmup ? start - config.simpoint_warmup : 0, false);
+        skip_to(start, true);
+        pipe_restart();
+        if (HLT) {
+            printf("Error: the program ended before point %" PRIu64 "\n", points[i].interval);
+            halt();
+            break;
+        }
+
+        pipe_counters_t from, to;
+        pipe_measure(length, &from, &to);
+        advance();
+
+        double n = (uint32_t)(to.insts - from.insts);
+        double cycles = (uint32_t)(to.cycles - from.cycles);
+        double w = points[i].weight;
+        if (n == 0)
+            continue;
+        printf("point %" PRIu64 " (weight %.3f): %.0f instructions, CPI %.3f\n",
+               points[i].interval, w, n, cycles / n);
+        weight += w;
+        cpi += w * cycles / n;
+        for (int l = 0; l < 4; l++) {
+            accesses[l] += w * (to.accesses[l] - from.accesses[l]) / n;
+            misses[l] += w * (to.misses[l] - from.misses[l]) / n;
+        }
+        branches += w * (to.branches - from.branches) / n;
+        mispredicts += w * (to.mispredicts - from.mispredicts) / n;
+        detailed += n;
+        simulated++;
+    }
+    free(points);
+    if (!weight) {
+        printf("No simulation points were simulated\n\n");
+        return;
+    }
+
+    static const char *LEVELS[] = { "L1I", "L1D", "L2", "LLC" };
+    double scale = total / weight;
+    printf("\nSimPoint estimate for %" PRIu64 " instructions from %d points "
+           "(%" PRIu64 " simulated in detail):\n", total, simulated, detailed);
+    printf("  CPI %.3f  cycles %.0f\n", cpi / weight, cpi * scale);
+    for (int l = 0; l < 4; l++) {
+        if (!accesses[l])
+            continue;
+        printf("  %-4s misses %.0f of %.0f accesses (%.2f%%)\n", LEVELS[l],
+               misses[l] * scale, accesses[l] * scale, 100 * misses[l] / accesses[l]);
+    }
+    printf("  branches %.0f  mispredicted %.0f (%.2f%%)\n\n", branches * scale,
+           mispredicts * scale, branches ? 100 * mispredicts / branches : 0.0);
+}
@@ -0,0 +1,25 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * SimPoint: a functional profiling run splits the program into fixed
+ * intervals of instructions, records a basic block vector for each,
+ * and clusters the vectors into phases. One interval per phase is
+ * simulated in detail and the phases' weights extrapolate the whole
+ * run. Both passes start from the beginning of the program.
+ */
+#ifndef _SIMPOINT_H_
+#define _SIMPOINT_H_
+
+#include <stdint.h>
+
+/* Run to HLT functionally, profiling every interval instructions, and
+ * write the chosen points to path. Returns the instructions run. */
+uint64_t simpoint_profile(uint64_t interval, const char *path);
+
+/* Simulate the points in path in detail and print the estimate. The
+ * simulator is left after the last point. */
+void simpoint_run(const char *path);
+
+#endif
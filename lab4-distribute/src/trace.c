@@ -0,0 +1,115 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned trace_mask;
+
+#define TRACE_BUFFER    (1 << 16)
+#define TRACE_LINE      256     /* room kept for one formatted line */
+
+static char buffer[TRACE_BUFFER];
+static size_t used;
+static FILE *out;
+
+static const struct {
+    const char *name;
+    unsigned mask;
+} CATEGORIES[] = {
+    { "cycle", TRACE_CYCLE },
+    { "fetch", TRACE_FETCH },
+    { "decode", TRACE_DECODE },
+    { "exec", TRACE_EXEC },
+    { "mem", TRACE_MEM },
+    { "wb", TRACE_WB },
+    { "bp", TRACE_BP },
+    { "cache", TRACE_CACHE },
+    { "all", TRACE_ALL },
+    { "pipe", TRACE_PIPE },
+};
+#define NUM_CATEGORIES (sizeof(CATEGORIES) / sizeof(CATEGORIES[0]))
+
+static unsigned trace_category(const char *name, size_t len)
+{
+    for (int i = 0; i < NUM_CATEGORIES; i++) {
+        if (strlen(CATEGORIES[i].name) == len &&
+            strncmp(CATEGORIES[i].name, name, len) == 0)
+            return CATEGORIES[i].mask;
+    }
+    printf("Error: unknown trace category %.*s\n", (int)len, name);
+    exit(-1);
+}
+
+void trace_init(const char *categories, const char *path)
+{
+    trace_mask = 0;
+    used = 0;
+    for (const char *p = categories; *p; ) {
+        size_t len = strcspn(p, ",");
+        if (len)
+            trace_mask |= trace_category(p, len);
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    if (!trace_mask)
+        return;
+    if ((trace_mask & TRACE_PIPE) &&
+        (trace_mask != TRACE_PIPE || strcmp(path, "-") == 0)) {
+        printf("Error: -trace=pipe is binary and needs a -trace_file of its own\n");
+        exit(-1);
+    }
+    if (TRACE_LEVEL == 0 && (trace_mask & TRACE_ALL))
+        printf("Warning: trace points are compiled out of this build; use sim-trace\n");
+
+    if (strcmp(path, "-") == 0)
+        out = stdout;
+    else if ((out = fopen(path, "wb")) == NULL) {
+        printf("Error: can't open trace file %s\n", path);
+        exit(-1);
+    }
+    atexit(trace_flush);
+}
+
+void trace_flush()
+{
+    if (out && used) {
+        fwrite(buffer, 1, used, out);
+        fflush(out);
+    }
+    used = 0;
+}
+
+void trace_write(const void *data, size_t size)
+{
+    if (used + size > TRACE_BUFFER)
+        trace_flush();
+    if (size > TRACE_BUFFER) {
+        fwrite(data, 1, size, out);
+        return;
+    }
+    memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void trace_printf(const char *fmt, ...)
+{
+    if (TRACE_BUFFER - used < TRACE_LINE)
+        trace_flush();
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer + used, TRACE_BUFFER - used, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    /* a longer line is cut short */
+    used += (size_t)n < TRACE_BUFFER - used ? (size_t)n : TRACE_BUFFER - used - 1;
+}
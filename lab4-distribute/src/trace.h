@@ -0,0 +1,58 @@
+/*
+ * CMSC 22200
+ *
+ * ARM pipeline timing simulator
+ *
+ * Tracing. A trace point names a level and a category:
+ *
+ *     TRACE(1, TRACE_MEM, "In MEM     | word: %0X\n", word);
+ *
+ * Points above TRACE_LEVEL are compiled out; the default build has
+ * level 0 and traces nothing, `make sim-trace` builds with level 2.
+ * The categories to record are chosen at run time with -trace=, and
+ * all output goes through one buffer that is written out in large
+ * blocks, to -trace_file or stdout.
+ *
+ * -trace=pipe is different: it is always compiled in, and writes the
+ * binary per-cycle records of pipetrace.h to -trace_file, which it
+ * needs to itself.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stddef.h>
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+#define TRACE_CYCLE     (1u << 0)
+#define TRACE_FETCH     (1u << 1)
+#define TRACE_DECODE    (1u << 2)
+#define TRACE_EXEC      (1u << 3)
+#define TRACE_MEM       (1u << 4)
+#define TRACE_WB        (1u << 5)
+#define TRACE_BP        (1u << 6)
+#define TRACE_CACHE     (1u << 7)
+#define TRACE_ALL       0xFFu       /* the text categories */
+#define TRACE_PIPE      (1u << 8)
+
+extern unsigned trace_mask;
+
+/* the condition is constant false above TRACE_LEVEL, so the compiler
+ * drops the call along with its arguments */
+#define TRACE(level, cat, ...)                                      \
+    do {                                                            \
+        if (TRACE_LEVEL >= (level) && (trace_mask & (cat)))         \
+            trace_printf(__VA_ARGS__);                              \
+    } while (0)
+
+/* categories is a comma-separated list of names or "all"; path "-"
+ * is stdout */
+void trace_init(const char *categories, const char *path);
+void trace_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+/* raw bytes, for binary records */
+void trace_write(const void *data, size_t size);
+void trace_flush();
+
+#endif